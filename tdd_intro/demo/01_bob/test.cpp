@@ -5,33 +5,193 @@ He answers 'Whoa, chill out!' if you yell at him. (! in the end)
 
 He says 'Fine. Be that way!' if you address him without actually saying anything.
 
+Yelling is also a message with letters, all of them capital, whatever it ends with.
+Spaces in the end of a message are ignored, message of only spaces is saying nothing.
+
 He answers 'Whatever.' to anything else.
 */
 #include <gtest/gtest.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
 #include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BOB_SSE2
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 static const char* s_whateverAnswer = "Whatever.";
 static const char* s_sureAnswer = "Sure.";
 static const char* s_fineAnswer = "Fine. Be that way!";
 static const char* s_chillOutAnswer = "Whoa, chill out!";
 
-const char* TellToBob(const std::string& message)
+enum CharClass
+{
+    Space = 1,
+    Upper = 2,
+    Lower = 4
+};
+
+struct CharClasses
 {
-    if (message.empty())
+    unsigned char classes[256];
+
+    CharClasses()
     {
-        return s_fineAnswer;
+        for (size_t c = 0; c < 256; ++c)
+        {
+            classes[c] = 0;
+        }
+        for (char c = 'A'; c <= 'Z'; ++c)
+        {
+            classes[static_cast<unsigned char>(c)] = Upper;
+        }
+        for (char c = 'a'; c <= 'z'; ++c)
+        {
+            classes[static_cast<unsigned char>(c)] = Lower;
+        }
+        for (char c : {' ', '\t', '\n', '\v', '\f', '\r'})
+        {
+            classes[static_cast<unsigned char>(c)] = Space;
+        }
     }
-    if (message.back() == '?')
+};
+
+struct MessageTraits
+{
+    // CharClass bits of all characters met
+    unsigned char classes;
+    // Whether there is a character which is not a space
+    bool hasContent;
+    // Last character which is not a space, meaningful only with hasContent
+    char last;
+};
+
+// Collects everything Bob looks at in one pass, without branching on characters
+MessageTraits ScanMessage(const char* message, size_t size)
+{
+    static const CharClasses s_charClasses;
+
+    MessageTraits traits = {0, false, '\0'};
+    for (size_t i = 0; i < size; ++i)
     {
-        return s_sureAnswer;
+        const unsigned char charClass = s_charClasses.classes[static_cast<unsigned char>(message[i])];
+        traits.classes |= charClass;
+        traits.hasContent |= charClass != Space;
+        traits.last = charClass == Space ? traits.last : message[i];
     }
-    else if (message.back() == '!')
+    return traits;
+}
+
+const char* TellToBob(const MessageTraits& traits)
+{
+    if (!traits.hasContent)
+    {
+        return s_fineAnswer;
+    }
+    if ((traits.classes & (Upper | Lower)) == Upper || traits.last == '!')
     {
         return s_chillOutAnswer;
     }
+    if (traits.last == '?')
+    {
+        return s_sureAnswer;
+    }
     return s_whateverAnswer;
 }
 
+const char* TellToBob(const char* message, size_t size)
+{
+    return TellToBob(ScanMessage(message, size));
+}
+
+const char* TellToBob(const std::string& message)
+{
+    return TellToBob(message.data(), message.size());
+}
+
+#if defined(BOB_SSE2)
+inline int GetHighestBit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanReverse(&index, mask);
+    return static_cast<int>(index);
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+// Bytes in [first, first + count) become 0xFF, others 0
+inline __m128i GetRangeMask(__m128i block, char first, char count)
+{
+    const __m128i shifted = _mm_add_epi8(block, _mm_set1_epi8(static_cast<char>(0x80 - first)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(0x80 + count)));
+}
+#endif
+
+// Same as ScanMessage, but classifies 16 characters at once where SSE2 is available
+MessageTraits ScanMessageSimd(const char* message, size_t size)
+{
+    MessageTraits traits = {0, false, '\0'};
+    size_t i = 0;
+#if defined(BOB_SSE2)
+    __m128i uppers = _mm_setzero_si128();
+    __m128i lowers = _mm_setzero_si128();
+    const char* lastBlock = nullptr;
+    unsigned int lastBlockMask = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(message + i));
+        uppers = _mm_or_si128(uppers, GetRangeMask(block, 'A', 26));
+        lowers = _mm_or_si128(lowers, GetRangeMask(block, 'a', 26));
+        const __m128i spaces = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')), GetRangeMask(block, '\t', 5));
+
+        const unsigned int notSpaces = ~static_cast<unsigned int>(_mm_movemask_epi8(spaces)) & 0xFFFF;
+        if (notSpaces != 0)
+        {
+            lastBlock = message + i;
+            lastBlockMask = notSpaces;
+        }
+    }
+
+    traits.classes |= _mm_movemask_epi8(uppers) != 0 ? Upper : 0;
+    traits.classes |= _mm_movemask_epi8(lowers) != 0 ? Lower : 0;
+    if (lastBlock != nullptr)
+    {
+        traits.hasContent = true;
+        traits.last = lastBlock[GetHighestBit(lastBlockMask)];
+    }
+#endif
+
+    const MessageTraits tail = ScanMessage(message + i, size - i);
+    traits.classes |= tail.classes;
+    traits.hasContent |= tail.hasContent;
+    traits.last = tail.hasContent ? tail.last : traits.last;
+    return traits;
+}
+
+// Message the caller keeps the characters of
+struct MessageView
+{
+    const char* text;
+    size_t size;
+};
+
+// Answers every message, answers[i] is for messages[i]
+void TellToBob(const MessageView* messages, size_t count, const char** answers)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        answers[i] = TellToBob(ScanMessageSimd(messages[i].text, messages[i].size));
+    }
+}
+
 TEST(Bob, Whatever)
 {
     ASSERT_STREQ(s_whateverAnswer, TellToBob("My name is Todd"));
@@ -56,3 +216,190 @@ TEST(Bob, ChillOut)
 {
     ASSERT_STREQ(s_chillOutAnswer, TellToBob("Answer something different!"));
 }
+
+TEST(Bob, FineOnlySpaces)
+{
+    ASSERT_STREQ(s_fineAnswer, TellToBob("  \t\n "));
+}
+
+TEST(Bob, SureTrailingSpaces)
+{
+    ASSERT_STREQ(s_sureAnswer, TellToBob("How are you?  \n"));
+}
+
+TEST(Bob, ChillOutTrailingSpaces)
+{
+    ASSERT_STREQ(s_chillOutAnswer, TellToBob("Stop it! "));
+}
+
+TEST(Bob, ChillOutCapitals)
+{
+    ASSERT_STREQ(s_chillOutAnswer, TellToBob("WATCH OUT"));
+}
+
+TEST(Bob, ChillOutCapitalQuestion)
+{
+    ASSERT_STREQ(s_chillOutAnswer, TellToBob("WHAT ARE YOU DOING?"));
+}
+
+TEST(Bob, SureNoLetters)
+{
+    ASSERT_STREQ(s_sureAnswer, TellToBob("4?"));
+}
+
+TEST(Bob, WhateverNoLetters)
+{
+    ASSERT_STREQ(s_whateverAnswer, TellToBob("1, 2, 3"));
+}
+
+TEST(Bob, WhateverQuestionMarkInside)
+{
+    ASSERT_STREQ(s_whateverAnswer, TellToBob("Are you sure? Fine then."));
+}
+
+TEST(Bob, WhateverEndsWithNul)
+{
+    ASSERT_STREQ(s_whateverAnswer, TellToBob(std::string("abc\0", 4)));
+}
+
+TEST(Bob, ReturnsStaticAnswers)
+{
+    const char message[] = "Is it you?";
+    ASSERT_EQ(s_sureAnswer, TellToBob(message, sizeof(message) - 1));
+}
+
+TEST(BobBatch, AnswersEveryMessage)
+{
+    const char* const texts[] = {"", "Are you robot?", "WATCH OUT, THE TRAIN IS COMING", "Answer something different!",
+                                 "Let's go make out behind the gym.                 ", "                    "};
+    MessageView messages[6];
+    for (size_t i = 0; i < 6; ++i)
+    {
+        messages[i] = {texts[i], std::strlen(texts[i])};
+    }
+    const char* answers[6] = {};
+    TellToBob(messages, 6, answers);
+
+    EXPECT_EQ(s_fineAnswer, answers[0]);
+    EXPECT_EQ(s_sureAnswer, answers[1]);
+    EXPECT_EQ(s_chillOutAnswer, answers[2]);
+    EXPECT_EQ(s_chillOutAnswer, answers[3]);
+    EXPECT_EQ(s_whateverAnswer, answers[4]);
+    EXPECT_EQ(s_fineAnswer, answers[5]);
+}
+
+TEST(BobBatch, EndsWithNul)
+{
+    const MessageView messages[] = {{"Is it the end of the line\0", 26}, {"  \0  ", 5}};
+    const char* answers[2] = {};
+    TellToBob(messages, 2, answers);
+
+    EXPECT_EQ(s_whateverAnswer, answers[0]);
+    EXPECT_EQ(s_whateverAnswer, answers[1]);
+}
+
+TEST(BobBatch, SameAsScalar)
+{
+    const char alphabet[] = "aZ?! \t\n\r\x0B\x0C1.@[`{\x80\xC3\xFF\0";
+    std::vector<std::string> messages;
+    unsigned int seed = 9;
+    for (size_t length = 0; length < 100; ++length)
+    {
+        for (size_t variant = 0; variant < 50; ++variant)
+        {
+            std::string message;
+            for (size_t i = 0; i < length; ++i)
+            {
+                seed = seed * 1103515245 + 12345;
+                // Mostly one kind of letters, so that yelling happens too
+                const size_t letter = (seed >> 16) % (variant % 2 ? sizeof(alphabet) - 1 : 3);
+                message += alphabet[variant % 2 ? letter : letter + 1];
+            }
+            messages.push_back(message);
+        }
+    }
+
+    // Views of one shared buffer, as messages usually come
+    std::string buffer;
+    for (const std::string& message : messages)
+    {
+        buffer += message;
+    }
+    std::vector<MessageView> views;
+    for (size_t i = 0, offset = 0; i < messages.size(); offset += messages[i++].size())
+    {
+        views.push_back({buffer.data() + offset, messages[i].size()});
+    }
+
+    std::vector<const char*> answers(messages.size());
+    TellToBob(views.data(), views.size(), answers.data());
+    for (size_t i = 0; i < messages.size(); ++i)
+    {
+        ASSERT_EQ(TellToBob(messages[i]), answers[i]) << i;
+    }
+}
+
+// Benchmarks are disabled by default, run them with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+
+// Calls the function for half a second and returns how many times per second it ran
+template<typename Function>
+double GetRunsPerSecond(Function function)
+{
+    const auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed(0);
+    size_t runs = 0;
+    while (elapsed.count() < 0.5)
+    {
+        function();
+        ++runs;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    return runs / elapsed.count();
+}
+
+TEST(BobBatchBenchmark, DISABLED_MessagesPerSecond)
+{
+    // Chat messages of 1 to 200 characters in one buffer, a few of them yelled or asked
+    const char* const endings[] = {"", "?", "!", ".", "  "};
+    std::string buffer;
+    std::vector<size_t> sizes;
+    unsigned int seed = 21;
+    for (size_t i = 0; i < 100000; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        const size_t length = 1 + (seed >> 16) % 200;
+        const bool yelled = (seed >> 8) % 10 == 0;
+        const size_t begin = buffer.size();
+        for (size_t letter = 0; letter < length; ++letter)
+        {
+            seed = seed * 1103515245 + 12345;
+            const unsigned int random = (seed >> 16) % 32;
+            buffer += random < 5 ? ' ' : static_cast<char>((yelled ? 'A' : 'a') + random % 26);
+        }
+        buffer += endings[(seed >> 24) % 5];
+        sizes.push_back(buffer.size() - begin);
+    }
+
+    std::vector<MessageView> views;
+    for (size_t i = 0, offset = 0; i < sizes.size(); offset += sizes[i++])
+    {
+        views.push_back({buffer.data() + offset, sizes[i]});
+    }
+    std::vector<const char*> answers(views.size());
+
+    const double batchRuns = GetRunsPerSecond([&]()
+    {
+        TellToBob(views.data(), views.size(), answers.data());
+    });
+    const double scalarRuns = GetRunsPerSecond([&]()
+    {
+        for (size_t i = 0; i < views.size(); ++i)
+        {
+            answers[i] = TellToBob(views[i].text, views[i].size);
+        }
+    });
+
+    std::cout << "[ MEASURED ] Batch TellToBob: " << batchRuns * views.size() << " messages/s" << std::endl;
+    std::cout << "[ MEASURED ] Scalar TellToBob: " << scalarRuns * views.size() << " messages/s" << std::endl;
+    EXPECT_NE(nullptr, answers.back());
+}
@@ -1,5 +1,16 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
 /*
  * The program should answer "Fizz" if the input number is multiple of 3, Buzz - if you specify a number which is multiple of 5,
@@ -24,6 +35,399 @@ std::string FizzBuzz(size_t number)
     return answer;
 }
 
+const size_t s_fizzBuzzPeriod = 15;
+
+struct FizzBuzzAnswer
+{
+    const char* text;
+    size_t length;
+};
+
+// Answers for every remainder of division by 15, nullptr where the number itself is written
+const FizzBuzzAnswer s_fizzBuzzCycle[s_fizzBuzzPeriod] = {
+    {"FizzBuzz", 8}, {nullptr, 0}, {nullptr, 0}, {"Fizz", 4}, {nullptr, 0}, {"Buzz", 4}, {"Fizz", 4}, {nullptr, 0},
+    {nullptr, 0}, {"Fizz", 4}, {"Buzz", 4}, {nullptr, 0}, {"Fizz", 4}, {nullptr, 0}, {nullptr, 0}
+};
+
+// Writes the FizzBuzz sequence one line per number, the number itself goes where FizzBuzz() has no answer.
+// Keeps the position in the 15 numbers cycle and the decimal digits of the number instead of dividing.
+class FizzBuzzGenerator
+{
+public:
+    static const size_t s_maxLineLength = std::numeric_limits<size_t>::digits10 + 2;
+
+    explicit FizzBuzzGenerator(size_t first)
+        : m_next(first)
+        , m_phase(first % s_fizzBuzzPeriod)
+        , m_digitsBegin(s_maxDigits)
+    {
+        do
+        {
+            m_digits[--m_digitsBegin] = static_cast<char>('0' + first % 10);
+            first /= 10;
+        }
+        while (first != 0);
+    }
+
+    // Writes lines for numbers up to last while they fit into [out, outEnd), returns the end of written data
+    char* Fill(char* out, const char* outEnd, size_t last)
+    {
+        while (m_next < last && static_cast<size_t>(outEnd - out) >= s_maxLineLength)
+        {
+            out = WriteLine(out);
+        }
+        return out;
+    }
+
+    // Writes lines for all numbers up to last, out must have room for GetFizzBuzzOutputSize(GetNext(), last) bytes
+    char* FillAll(char* out, size_t last)
+    {
+        while (m_next < last)
+        {
+            out = WriteLine(out);
+        }
+        return out;
+    }
+
+    size_t GetNext() const
+    {
+        return m_next;
+    }
+
+private:
+    char* WriteLine(char* out)
+    {
+        const FizzBuzzAnswer& answer = s_fizzBuzzCycle[m_phase];
+        if (answer.text != nullptr)
+        {
+            std::memcpy(out, answer.text, answer.length);
+            out += answer.length;
+        }
+        else
+        {
+            std::memcpy(out, m_digits + m_digitsBegin, s_maxDigits - m_digitsBegin);
+            out += s_maxDigits - m_digitsBegin;
+        }
+        *out++ = '\n';
+
+        m_phase = m_phase + 1 == s_fizzBuzzPeriod ? 0 : m_phase + 1;
+        IncrementDigits();
+        ++m_next;
+        return out;
+    }
+
+    void IncrementDigits()
+    {
+        size_t digit = s_maxDigits;
+        while (digit-- > m_digitsBegin && m_digits[digit] == '9')
+        {
+            m_digits[digit] = '0';
+        }
+        if (digit + 1 == m_digitsBegin)
+        {
+            // All digits were 9, size_t can not have that many of them, so there is room for one more
+            m_digits[--m_digitsBegin] = '1';
+        }
+        else
+        {
+            ++m_digits[digit];
+        }
+    }
+
+private:
+    static const size_t s_maxDigits = s_maxLineLength - 1;
+
+    size_t m_next;
+    size_t m_phase;
+    size_t m_digitsBegin;
+    char m_digits[s_maxDigits];
+};
+
+// Writes lines for numbers in [first, last) to the stream in large blocks
+void WriteFizzBuzz(size_t first, size_t last, std::ostream& output)
+{
+    std::vector<char> block(1 << 16);
+    FizzBuzzGenerator generator(first);
+    while (generator.GetNext() < last)
+    {
+        const char* end = generator.Fill(block.data(), block.data() + block.size(), last);
+        output.write(block.data(), end - block.data());
+    }
+}
+
+// Count of multiples of divisor in [0, end)
+size_t CountMultiples(size_t end, size_t divisor)
+{
+    return end == 0 ? 0 : (end - 1) / divisor + 1;
+}
+
+// Count of multiples of divisor in [first, last)
+size_t CountMultiples(size_t first, size_t last, size_t divisor)
+{
+    return CountMultiples(last, divisor) - CountMultiples(first, divisor);
+}
+
+// Exact size of WriteFizzBuzz output for [first, last), counted per decimal length of numbers without writing them
+size_t GetFizzBuzzOutputSize(size_t first, size_t last)
+{
+    if (first >= last)
+    {
+        return 0;
+    }
+
+    const size_t fizzBuzz = CountMultiples(first, last, 15);
+    const size_t fizz = CountMultiples(first, last, 3) - fizzBuzz;
+    const size_t buzz = CountMultiples(first, last, 5) - fizzBuzz;
+    size_t size = (last - first) + (fizz + buzz) * 4 + fizzBuzz * 8;
+
+    size_t digitsBegin = 0;
+    for (size_t digits = 1; digitsBegin < last; ++digits)
+    {
+        // Numbers with this many digits are [digitsBegin, digitsEnd), the last band ends at the largest size_t
+        const bool lastBand = digitsBegin > std::numeric_limits<size_t>::max() / 10;
+        const size_t digitsEnd = lastBand ? std::numeric_limits<size_t>::max() : std::max<size_t>(digitsBegin * 10, 10);
+        const size_t bandFirst = std::max(first, digitsBegin);
+        const size_t bandLast = std::min(last, digitsEnd);
+        if (bandFirst < bandLast)
+        {
+            const size_t numbers = (bandLast - bandFirst) - CountMultiples(bandFirst, bandLast, 3) -
+                                   CountMultiples(bandFirst, bandLast, 5) + CountMultiples(bandFirst, bandLast, 15);
+            size += numbers * digits;
+        }
+        if (lastBand)
+        {
+            break;
+        }
+        digitsBegin = digitsEnd;
+    }
+    return size;
+}
+
+// Size of equal parts covering span, rounded up without overflowing near the largest size_t
+size_t GetPartSize(size_t span, size_t parts)
+{
+    return span / parts + (span % parts != 0);
+}
+
+// Splits the range between threads, each of them computes where its part of the output starts
+// and writes it right into the shared result, so no merging of parts is needed. Zero threads means one.
+std::string WriteFizzBuzzParallel(size_t first, size_t last, size_t threadsCount)
+{
+    if (first >= last)
+    {
+        return std::string();
+    }
+
+    threadsCount = std::max<size_t>(threadsCount, 1);
+    std::string output(GetFizzBuzzOutputSize(first, last), '\0');
+    const size_t partSize = GetPartSize(last - first, threadsCount);
+    std::vector<std::thread> threads;
+    for (size_t partFirst = first; partFirst < last; partFirst += std::min(partSize, last - partFirst))
+    {
+        const size_t partLast = partFirst + std::min(partSize, last - partFirst);
+        char* out = &output[0] + GetFizzBuzzOutputSize(first, partFirst);
+        threads.emplace_back([partFirst, partLast, out]()
+        {
+            FizzBuzzGenerator(partFirst).FillAll(out, partLast);
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    return output;
+}
+
+struct FizzBuzzRule
+{
+    size_t divisor;
+    const char* word;
+};
+
+template<size_t... Indices>
+struct IndexSequence
+{
+};
+
+template<typename Left, typename Right>
+struct ConcatIndexSequences;
+
+template<size_t... Left, size_t... Right>
+struct ConcatIndexSequences<IndexSequence<Left...>, IndexSequence<Right...>>
+{
+    typedef IndexSequence<Left..., (sizeof...(Left) + Right)...> type;
+};
+
+// Splits in halves to keep template recursion depth logarithmic
+template<size_t Size>
+struct MakeIndexSequence
+{
+    typedef typename ConcatIndexSequences<typename MakeIndexSequence<Size / 2>::type,
+                                          typename MakeIndexSequence<Size - Size / 2>::type>::type type;
+};
+
+template<>
+struct MakeIndexSequence<0>
+{
+    typedef IndexSequence<> type;
+};
+
+template<>
+struct MakeIndexSequence<1>
+{
+    typedef IndexSequence<0> type;
+};
+
+constexpr size_t GetGreatestCommonDivisor(size_t left, size_t right)
+{
+    return right == 0 ? left : GetGreatestCommonDivisor(right, left % right);
+}
+
+// Throws if the product does not fit into size_t, in constant expressions this fails compilation
+constexpr size_t MultiplyWithoutOverflow(size_t left, size_t right)
+{
+    return right != 0 && left > std::numeric_limits<size_t>::max() / right
+            ? throw std::overflow_error("Least common multiple of divisors does not fit into size_t")
+            : left * right;
+}
+
+constexpr size_t GetLeastCommonMultiple(size_t left, size_t right)
+{
+    return left == 0 || right == 0 ? throw std::invalid_argument("Divisor of a rule must not be 0")
+                                   : MultiplyWithoutOverflow(left / GetGreatestCommonDivisor(left, right), right);
+}
+
+// Least common multiple of all divisors, the labels repeat with this period
+constexpr size_t GetRulesPeriod(const FizzBuzzRule* rules, size_t count)
+{
+    return count == 0 ? 1 : GetLeastCommonMultiple(rules[0].divisor, GetRulesPeriod(rules + 1, count - 1));
+}
+
+// Bit i is set if rule i applies to the number
+constexpr unsigned int GetRulesMask(const FizzBuzzRule* rules, size_t count, size_t number)
+{
+    return count == 0 ? 0 : ((number % rules[count - 1].divisor == 0 ? 1u : 0u) << (count - 1)) |
+                            GetRulesMask(rules, count - 1, number);
+}
+
+template<typename Rules, typename Indices>
+struct RulesMaskTable;
+
+template<typename Rules, size_t... Indices>
+struct RulesMaskTable<Rules, IndexSequence<Indices...>>
+{
+    static constexpr unsigned int masks[sizeof...(Indices)] = {GetRulesMask(Rules::rules, Rules::count, Indices)...};
+};
+
+template<typename Rules, size_t... Indices>
+constexpr unsigned int RulesMaskTable<Rules, IndexSequence<Indices...>>::masks[sizeof...(Indices)];
+
+std::string GetLabel(const FizzBuzzRule* rules, size_t count, unsigned int mask)
+{
+    std::string label;
+    for (size_t rule = 0; rule < count; ++rule)
+    {
+        if (mask & (1u << rule))
+        {
+            label += rules[rule].word;
+        }
+    }
+    return label;
+}
+
+// Labels numbers by rules known at compile time: Rules is a type with static constexpr members
+// "FizzBuzzRule rules[]" and "size_t count". Which rules apply to every number of the period
+// is computed by the compiler, labelling a range just walks this table.
+template<typename Rules>
+class StaticRulesLabeler
+{
+public:
+    static constexpr size_t s_period = GetRulesPeriod(Rules::rules, Rules::count);
+    static_assert(Rules::count <= 32, "Rule masks have 32 bits");
+    static_assert(s_period <= 65536, "Period of rules is too long for a table");
+
+    typedef RulesMaskTable<Rules, typename MakeIndexSequence<s_period>::type> Table;
+
+    // Calls sink(number, label) for every number in [first, last), label is empty if no rule applies
+    template<typename Sink>
+    static void Label(size_t first, size_t last, Sink sink)
+    {
+        static const std::vector<std::string> s_labels = GetLabels();
+        size_t slot = first % s_period;
+        for (size_t number = first; number != last; ++number)
+        {
+            sink(number, s_labels[slot]);
+            slot = slot + 1 == s_period ? 0 : slot + 1;
+        }
+    }
+
+private:
+    static std::vector<std::string> GetLabels()
+    {
+        std::vector<std::string> labels;
+        for (size_t slot = 0; slot < s_period; ++slot)
+        {
+            labels.push_back(GetLabel(Rules::rules, Rules::count, Table::masks[slot]));
+        }
+        return labels;
+    }
+};
+
+struct FizzBuzzRules
+{
+    static constexpr size_t count = 2;
+    static constexpr FizzBuzzRule rules[count] = {{3, "Fizz"}, {5, "Buzz"}};
+};
+
+constexpr FizzBuzzRule FizzBuzzRules::rules[];
+
+// Labels numbers by rules known only at run time. Every rule counts down numbers left
+// to its next multiple, like a wheel, so no division is done per number.
+class RulesLabeler
+{
+public:
+    explicit RulesLabeler(const std::vector<FizzBuzzRule>& rules) : m_rules(rules)
+    {
+        for (const FizzBuzzRule& rule : m_rules)
+        {
+            if (rule.divisor == 0)
+            {
+                throw std::invalid_argument("Divisor of a rule must not be 0");
+            }
+        }
+    }
+
+    // Calls sink(number, label) for every number in [first, last), label is empty if no rule applies
+    template<typename Sink>
+    void Label(size_t first, size_t last, Sink sink) const
+    {
+        std::vector<size_t> countdowns;
+        for (const FizzBuzzRule& rule : m_rules)
+        {
+            countdowns.push_back((rule.divisor - first % rule.divisor) % rule.divisor);
+        }
+
+        std::string label;
+        for (size_t number = first; number != last; ++number)
+        {
+            label.clear();
+            for (size_t rule = 0; rule < m_rules.size(); ++rule)
+            {
+                if (countdowns[rule] == 0)
+                {
+                    label += m_rules[rule].word;
+                    countdowns[rule] = m_rules[rule].divisor;
+                }
+                --countdowns[rule];
+            }
+            sink(number, label);
+        }
+    }
+
+private:
+    std::vector<FizzBuzzRule> m_rules;
+};
+
 TEST(FizzBuzzTest, Fizz)
 {
     EXPECT_STREQ("Fizz", FizzBuzz(3).c_str());
@@ -58,3 +462,313 @@ TEST(FizzBuzzTest, Acceptance)
     EXPECT_STREQ("FizzBuzz", FizzBuzz(120).c_str());
     EXPECT_STREQ("FizzBuzz", FizzBuzz(3300).c_str());
 }
+
+std::string WriteFizzBuzzToString(size_t first, size_t last)
+{
+    std::ostringstream output;
+    WriteFizzBuzz(first, last, output);
+    return output.str();
+}
+
+std::string GetFizzBuzzLines(size_t first, size_t last)
+{
+    std::string lines;
+    for (size_t number = first; number != last; ++number)
+    {
+        const std::string answer = FizzBuzz(number);
+        lines += (answer.empty() ? std::to_string(number) : answer) + "\n";
+    }
+    return lines;
+}
+
+TEST(WriteFizzBuzz, EmptyRange)
+{
+    EXPECT_EQ("", WriteFizzBuzzToString(10, 10));
+}
+
+TEST(WriteFizzBuzz, FirstNumbers)
+{
+    EXPECT_EQ("1\n2\nFizz\n4\nBuzz\nFizz\n7\n8\nFizz\nBuzz\n11\nFizz\n13\n14\nFizzBuzz\n16\n",
+              WriteFizzBuzzToString(1, 17));
+}
+
+TEST(WriteFizzBuzz, Zero)
+{
+    EXPECT_EQ("FizzBuzz\n1\n", WriteFizzBuzzToString(0, 2));
+}
+
+TEST(WriteFizzBuzz, SameAsFizzBuzz)
+{
+    EXPECT_EQ(GetFizzBuzzLines(1, 100000), WriteFizzBuzzToString(1, 100000));
+}
+
+TEST(WriteFizzBuzz, DigitsCarry)
+{
+    EXPECT_EQ(GetFizzBuzzLines(95, 105), WriteFizzBuzzToString(95, 105));
+    EXPECT_EQ(GetFizzBuzzLines(999990, 1000010), WriteFizzBuzzToString(999990, 1000010));
+}
+
+TEST(WriteFizzBuzz, LargestNumbers)
+{
+    const size_t last = std::numeric_limits<size_t>::max();
+    EXPECT_EQ(GetFizzBuzzLines(last - 40, last), WriteFizzBuzzToString(last - 40, last));
+}
+
+// Benchmarks are disabled by default, run them with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+
+// Shortest time of several calls of the function, in seconds
+template<typename Function>
+double GetBestSeconds(Function function)
+{
+    double best = std::numeric_limits<double>::max();
+    for (size_t run = 0; run < 5; ++run)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        function();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+#if defined(_WIN32)
+const char* const s_nullDevice = "NUL";
+#else
+const char* const s_nullDevice = "/dev/null";
+#endif
+
+TEST(WriteFizzBuzzBenchmark, DISABLED_ToNullDevice)
+{
+    const size_t first = 1;
+    const size_t last = 100000000;
+    const double gigabytes = GetFizzBuzzOutputSize(first, last) / 1e9;
+
+    std::ofstream output(s_nullDevice, std::ios::binary);
+    ASSERT_TRUE(output.is_open());
+    const double seconds = GetBestSeconds([&]()
+    {
+        WriteFizzBuzz(first, last, output);
+    });
+    EXPECT_TRUE(output.good());
+    std::cout << "[ MEASURED ] WriteFizzBuzz: " << gigabytes / seconds << " GB/s" << std::endl;
+
+    // A string per number, as FizzBuzz() does it, on a hundredth of the range
+    const size_t stringsLast = last / 100;
+    const double stringsSeconds = GetBestSeconds([&]()
+    {
+        for (size_t number = first; number < stringsLast; ++number)
+        {
+            const std::string answer = FizzBuzz(number);
+            output << (answer.empty() ? std::to_string(number) : answer) << '\n';
+        }
+    });
+    std::cout << "[ MEASURED ] FizzBuzz strings: " << GetFizzBuzzOutputSize(first, stringsLast) / 1e9 / stringsSeconds
+              << " GB/s" << std::endl;
+}
+
+TEST(FizzBuzzGenerator, CycleLengths)
+{
+    for (const FizzBuzzAnswer& answer : s_fizzBuzzCycle)
+    {
+        EXPECT_EQ(answer.text == nullptr ? 0 : std::strlen(answer.text), answer.length);
+    }
+}
+
+TEST(FizzBuzzGenerator, StopsWhenBlockIsFull)
+{
+    FizzBuzzGenerator generator(1);
+    std::vector<char> block(FizzBuzzGenerator::s_maxLineLength * 2);
+
+    char* end = generator.Fill(block.data(), block.data() + block.size(), 100);
+    // Writes only while the longest possible line still fits
+    EXPECT_EQ("1\n2\nFizz\n4\nBuzz\nFizz\n7\n", std::string(block.data(), end));
+    EXPECT_EQ(8u, generator.GetNext());
+}
+
+struct FooBarBazRules
+{
+    static constexpr size_t count = 3;
+    static constexpr FizzBuzzRule rules[count] = {{2, "Foo"}, {7, "Bar"}, {3, "Baz"}};
+};
+
+constexpr FizzBuzzRule FooBarBazRules::rules[];
+
+// As many rules as the masks have bits, divisors are powers of two up to 128
+struct ThirtyTwoRules
+{
+    static constexpr size_t count = 32;
+    static constexpr FizzBuzzRule rules[count] = {
+        {1, "a"}, {2, "b"}, {4, "c"}, {8, "d"}, {16, "e"}, {32, "f"}, {64, "g"}, {128, "h"},
+        {1, "i"}, {2, "j"}, {4, "k"}, {8, "l"}, {16, "m"}, {32, "n"}, {64, "o"}, {128, "p"},
+        {1, "q"}, {2, "r"}, {4, "s"}, {8, "t"}, {16, "u"}, {32, "v"}, {64, "w"}, {128, "x"},
+        {1, "y"}, {2, "z"}, {4, "a2"}, {8, "b2"}, {16, "c2"}, {32, "d2"}, {64, "e2"}, {128, "f2"}
+    };
+};
+
+constexpr FizzBuzzRule ThirtyTwoRules::rules[];
+
+std::vector<std::string> GetReferenceLabels(const std::vector<FizzBuzzRule>& rules, size_t first, size_t last)
+{
+    std::vector<std::string> labels;
+    for (size_t number = first; number != last; ++number)
+    {
+        std::string label;
+        for (const FizzBuzzRule& rule : rules)
+        {
+            if (number % rule.divisor == 0)
+            {
+                label += rule.word;
+            }
+        }
+        labels.push_back(label);
+    }
+    return labels;
+}
+
+template<typename Labeler>
+std::vector<std::string> CollectLabels(const Labeler& labeler, size_t first, size_t last)
+{
+    std::vector<std::string> labels;
+    labeler.Label(first, last, [&labels](size_t, const std::string& label)
+    {
+        labels.push_back(label);
+    });
+    return labels;
+}
+
+TEST(RulesPeriod, LeastCommonMultiple)
+{
+    static_assert(StaticRulesLabeler<FizzBuzzRules>::s_period == 15, "FizzBuzz repeats every 15 numbers");
+    static_assert(StaticRulesLabeler<FooBarBazRules>::s_period == 42, "FooBarBaz repeats every 42 numbers");
+    static_assert(StaticRulesLabeler<FizzBuzzRules>::Table::masks[0] == 3, "0 is FizzBuzz");
+    static_assert(StaticRulesLabeler<FizzBuzzRules>::Table::masks[9] == 1, "9 is Fizz");
+    static_assert(StaticRulesLabeler<FizzBuzzRules>::Table::masks[10] == 2, "10 is Buzz");
+    EXPECT_EQ(1u, GetRulesPeriod(nullptr, 0));
+}
+
+TEST(RulesPeriod, ThirtyTwoRules)
+{
+    static_assert(StaticRulesLabeler<ThirtyTwoRules>::s_period == 128, "Largest divisor is 128");
+    static_assert(StaticRulesLabeler<ThirtyTwoRules>::Table::masks[0] == 0xFFFFFFFF, "0 is a multiple of everything");
+    static_assert(StaticRulesLabeler<ThirtyTwoRules>::Table::masks[6] == 0x03030303, "6 is a multiple of 1 and 2");
+}
+
+TEST(RulesPeriod, ThrowsOnOverflow)
+{
+    static_assert(GetLeastCommonMultiple(4, 6) == 12, "lcm(4, 6) is 12");
+    const size_t largest = std::numeric_limits<size_t>::max();
+    EXPECT_EQ(largest, GetLeastCommonMultiple(largest, 1));
+    EXPECT_EQ(largest, GetLeastCommonMultiple(largest, largest));
+    EXPECT_THROW(GetLeastCommonMultiple(largest, 2), std::overflow_error);
+
+    const FizzBuzzRule rules[] = {{largest - 1, "Foo"}, {largest, "Bar"}};
+    EXPECT_THROW(GetRulesPeriod(rules, 2), std::overflow_error);
+    EXPECT_THROW(GetLeastCommonMultiple(0, 3), std::invalid_argument);
+}
+
+TEST(StaticRulesLabeler, SameAsFizzBuzz)
+{
+    std::vector<std::string> expected;
+    for (size_t number = 7; number < 1007; ++number)
+    {
+        expected.push_back(FizzBuzz(number));
+    }
+    EXPECT_EQ(expected, CollectLabels(StaticRulesLabeler<FizzBuzzRules>(), 7, 1007));
+}
+
+TEST(StaticRulesLabeler, CustomRules)
+{
+    const std::vector<FizzBuzzRule> rules = {{2, "Foo"}, {7, "Bar"}, {3, "Baz"}};
+    EXPECT_EQ(GetReferenceLabels(rules, 100, 300), CollectLabels(StaticRulesLabeler<FooBarBazRules>(), 100, 300));
+}
+
+TEST(RulesLabeler, SameAsFizzBuzz)
+{
+    const RulesLabeler labeler({{3, "Fizz"}, {5, "Buzz"}});
+    std::vector<std::string> expected;
+    for (size_t number = 0; number < 1000; ++number)
+    {
+        expected.push_back(FizzBuzz(number));
+    }
+    EXPECT_EQ(expected, CollectLabels(labeler, 0, 1000));
+}
+
+TEST(RulesLabeler, CustomRules)
+{
+    const std::vector<FizzBuzzRule> rules = {{4, "Four"}, {6, "Six"}, {1000003, "Prime"}, {1, "One"}};
+    const RulesLabeler labeler(rules);
+    EXPECT_EQ(GetReferenceLabels(rules, 999990, 1001000), CollectLabels(labeler, 999990, 1001000));
+}
+
+TEST(RulesLabeler, NoRules)
+{
+    const RulesLabeler labeler(std::vector<FizzBuzzRule>{});
+    EXPECT_EQ(std::vector<std::string>(5), CollectLabels(labeler, 0, 5));
+}
+
+TEST(RulesLabeler, ZeroDivisor)
+{
+    EXPECT_THROW(RulesLabeler({{0, "Zero"}}), std::invalid_argument);
+}
+
+TEST(GetFizzBuzzOutputSize, SameAsWritten)
+{
+    const size_t largest = std::numeric_limits<size_t>::max();
+    const size_t ranges[][2] = {
+        {0, 0}, {5, 3}, {0, 1}, {1, 16}, {1, 100000}, {7, 10}, {9, 11}, {95, 105},
+        {999990, 1000010}, {largest - 40, largest}
+    };
+    for (const auto& range : ranges)
+    {
+        EXPECT_EQ(WriteFizzBuzzToString(range[0], range[1]).size(), GetFizzBuzzOutputSize(range[0], range[1]));
+    }
+}
+
+TEST(GetFizzBuzzOutputSize, HugeRange)
+{
+    // 1..9: 3 Fizz, 1 Buzz, 5 one digit numbers, 9 new lines
+    EXPECT_EQ(3u * 4 + 1 * 4 + 5 + 9, GetFizzBuzzOutputSize(1, 10));
+    EXPECT_EQ(GetFizzBuzzOutputSize(1, 5000000000) + GetFizzBuzzOutputSize(5000000000, 10000000000),
+              GetFizzBuzzOutputSize(1, 10000000000));
+}
+
+TEST(WriteFizzBuzzParallel, SameAsSequential)
+{
+    const std::string expected = WriteFizzBuzzToString(1, 200000);
+    for (size_t threadsCount = 1; threadsCount <= 8; ++threadsCount)
+    {
+        ASSERT_EQ(expected, WriteFizzBuzzParallel(1, 200000, threadsCount));
+    }
+}
+
+TEST(WriteFizzBuzzParallel, MoreThreadsThanNumbers)
+{
+    EXPECT_EQ("Fizz\n4\n", WriteFizzBuzzParallel(3, 5, 8));
+    EXPECT_EQ("", WriteFizzBuzzParallel(5, 5, 8));
+}
+
+TEST(WriteFizzBuzzParallel, ZeroThreads)
+{
+    EXPECT_EQ("1\n", WriteFizzBuzzParallel(1, 2, 0));
+    EXPECT_EQ(WriteFizzBuzzToString(1, 100), WriteFizzBuzzParallel(1, 100, 0));
+}
+
+TEST(GetPartSize, RoundsUp)
+{
+    EXPECT_EQ(4u, GetPartSize(10, 3));
+    EXPECT_EQ(5u, GetPartSize(10, 2));
+    EXPECT_EQ(1u, GetPartSize(3, 8));
+}
+
+TEST(GetPartSize, HugeSpan)
+{
+    const size_t span = std::numeric_limits<size_t>::max();
+    EXPECT_EQ(span / 4 + 1, GetPartSize(span, 4));
+    EXPECT_EQ(span, GetPartSize(span, 1));
+}
+
+TEST(WriteFizzBuzzParallel, LargestNumbers)
+{
+    const size_t last = std::numeric_limits<size_t>::max();
+    EXPECT_EQ(WriteFizzBuzzToString(last - 1000, last), WriteFizzBuzzParallel(last - 1000, last, 3));
+}
@@ -6,18 +6,60 @@ Given "listen" and a list of candidates like "enlists" "google" "inlets" "banana
 _from http://exercism.io/_
 */
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ANAGRAM_SSE2
+#endif
 
 using Anagrams = std::set<std::string>;
 
-bool IsAnagrams(std::string left, std::string right)
+// Every byte of left adds one to its bin and every byte of right takes one away,
+// so the words are anagrams when all bins are back at zero
+bool IsLetterBalanceZero(const int (&balance)[256])
 {
-    if (left == right || left.empty() || right.empty())
+#if defined(ANAGRAM_SSE2)
+    __m128i any = _mm_setzero_si128();
+    for (size_t i = 0; i < 256; i += 4)
+    {
+        any = _mm_or_si128(any, _mm_loadu_si128(reinterpret_cast<const __m128i*>(balance + i)));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(any, _mm_setzero_si128())) == 0xFFFF;
+#else
+    int any = 0;
+    for (int bin : balance)
+    {
+        any |= bin;
+    }
+    return any == 0;
+#endif
+}
+
+bool IsAnagrams(const std::string& left, const std::string& right)
+{
+    if (left.size() != right.size() || left.empty() || left == right)
     {
         return false;
     }
-    std::sort (left.begin(), left.end());
-    std::sort (right.begin(), right.end());
-    return left == right;
+
+    int balance[256] = {};
+    for (size_t i = 0; i < left.size(); ++i)
+    {
+        ++balance[static_cast<unsigned char>(left[i])];
+        --balance[static_cast<unsigned char>(right[i])];
+    }
+    return IsLetterBalanceZero(balance);
 }
 
 Anagrams GetAnagrams(const std::string& word, const std::vector<std::string>& candidates)
@@ -29,6 +71,302 @@ Anagrams GetAnagrams(const std::string& word, const std::vector<std::string>& ca
     return anagrams;
 }
 
+// Lower case for ASCII without branches: only 'A'..'Z' get the 0x20 bit
+inline unsigned char FoldAsciiCase(unsigned char c)
+{
+    return c | static_cast<unsigned char>((static_cast<unsigned char>(c - 'A') < 26) << 5);
+}
+
+// Upper case letters beyond ASCII with a lower case at a fixed distance
+struct CaseFoldRange
+{
+    char32_t first;
+    char32_t last;
+    char32_t delta;
+};
+
+static const CaseFoldRange s_caseFoldRanges[] =
+{
+    {0x00C0, 0x00D6, 0x20}, // Latin-1 capitals before the multiplication sign
+    {0x00D8, 0x00DE, 0x20}, // Latin-1 capitals after the multiplication sign
+    {0x0391, 0x03A1, 0x20}, // Greek capitals before the final sigma gap
+    {0x03A3, 0x03AB, 0x20}, // Greek capitals after the final sigma gap
+    {0x03C2, 0x03C2, 0x01}, // Greek final sigma is the same letter as sigma
+    {0x0400, 0x040F, 0x50}, // Cyrillic capitals of the extended letters
+    {0x0410, 0x042F, 0x20}, // Cyrillic capitals of the basic alphabet
+};
+
+char32_t FoldCase(char32_t codePoint)
+{
+    if (codePoint < 0x80)
+    {
+        return FoldAsciiCase(static_cast<unsigned char>(codePoint));
+    }
+    for (const CaseFoldRange& range : s_caseFoldRanges)
+    {
+        if (codePoint >= range.first && codePoint <= range.last)
+        {
+            return codePoint + range.delta;
+        }
+    }
+    return codePoint;
+}
+
+// Malformed bytes are marked beyond any code point
+const char32_t s_malformedByte = 0x80000000;
+
+// Malformed, overlong and surrogate sequences come out byte by byte, so they still only match the same bytes.
+// Every code point has one encoding and folding keeps its length, so matching words have the same size in bytes.
+std::vector<char32_t> GetFoldedCodePoints(const std::string& word)
+{
+    std::vector<char32_t> codePoints;
+    codePoints.reserve(word.size());
+    for (size_t i = 0; i < word.size();)
+    {
+        const unsigned char lead = static_cast<unsigned char>(word[i]);
+        const size_t length = lead < 0x80 ? 1 : lead >= 0xC2 && lead < 0xE0 ? 2 : lead >= 0xE0 && lead < 0xF0 ? 3
+                            : lead >= 0xF0 && lead < 0xF5 ? 4 : 0;
+        char32_t codePoint = length == 1 ? lead : lead & (0x7F >> length);
+        bool valid = length != 0 && i + length <= word.size();
+        for (size_t next = 1; valid && next < length; ++next)
+        {
+            const unsigned char continuation = static_cast<unsigned char>(word[i + next]);
+            valid = (continuation & 0xC0) == 0x80;
+            codePoint = (codePoint << 6) | (continuation & 0x3F);
+        }
+
+        static const char32_t s_shortest[] = {0, 0, 0x80, 0x800, 0x10000};
+        valid = valid && codePoint >= s_shortest[length] && codePoint <= 0x10FFFF &&
+                (codePoint < 0xD800 || codePoint > 0xDFFF);
+        if (valid)
+        {
+            codePoints.push_back(FoldCase(codePoint));
+            i += length;
+        }
+        else
+        {
+            codePoints.push_back(s_malformedByte | lead);
+            ++i;
+        }
+    }
+    return codePoints;
+}
+
+// Like IsAnagrams, but "Listen" and "Silent" are anagrams while "Listen" and "listen" are the same word.
+// Words are folded with a bit operation into the same histogram IsAnagrams uses in one pass, which also
+// notices bytes beyond ASCII; only then the words are decoded and folded through s_caseFoldRanges.
+// Letters are not normalised, so precomposed "\xC3\xA9" and "e\xCC\x81" stay different.
+bool IsAnagramsIgnoreCase(const std::string& left, const std::string& right)
+{
+    if (left.size() != right.size() || left.empty())
+    {
+        return false;
+    }
+
+    int balance[256] = {};
+    unsigned char difference = 0;
+    unsigned char bytes = 0;
+    for (size_t i = 0; i < left.size(); ++i)
+    {
+        const unsigned char leftLetter = FoldAsciiCase(static_cast<unsigned char>(left[i]));
+        const unsigned char rightLetter = FoldAsciiCase(static_cast<unsigned char>(right[i]));
+        ++balance[leftLetter];
+        --balance[rightLetter];
+        difference |= leftLetter ^ rightLetter;
+        bytes |= leftLetter | rightLetter;
+    }
+    if ((bytes & 0x80) == 0)
+    {
+        return difference != 0 && IsLetterBalanceZero(balance);
+    }
+
+    std::vector<char32_t> leftLetters = GetFoldedCodePoints(left);
+    std::vector<char32_t> rightLetters = GetFoldedCodePoints(right);
+    if (leftLetters.size() != rightLetters.size() || leftLetters == rightLetters)
+    {
+        return false;
+    }
+    std::sort(leftLetters.begin(), leftLetters.end());
+    std::sort(rightLetters.begin(), rightLetters.end());
+    return leftLetters == rightLetters;
+}
+
+Anagrams GetAnagramsIgnoreCase(const std::string& word, const std::vector<std::string>& candidates)
+{
+    Anagrams anagrams;
+    std::copy_if(candidates.begin(), candidates.end(), std::inserter(anagrams, anagrams.end()),
+                         [&](const std::string& candidate) {return IsAnagramsIgnoreCase(word, candidate);});
+
+    return anagrams;
+}
+
+// Anagrams have the same letters sorted
+std::string GetAnagramSignature(std::string word)
+{
+    std::sort(word.begin(), word.end());
+    return word;
+}
+
+// Groups a dictionary by anagram signature once,
+// so every query costs one signature and one hash lookup whatever the dictionary size
+class AnagramIndex
+{
+public:
+    explicit AnagramIndex(const std::vector<std::string>& dictionary)
+    {
+        for (const std::string& word : dictionary)
+        {
+            if (!word.empty())
+            {
+                m_words[GetAnagramSignature(word)].push_back(word);
+            }
+        }
+    }
+
+    Anagrams GetAnagrams(const std::string& word) const
+    {
+        Anagrams anagrams;
+        auto words = m_words.find(GetAnagramSignature(word));
+        if (words != m_words.end())
+        {
+            std::copy_if(words->second.begin(), words->second.end(), std::inserter(anagrams, anagrams.end()),
+                         [&](const std::string& candidate) {return candidate != word;});
+        }
+        return anagrams;
+    }
+
+private:
+    std::unordered_map<std::string, std::vector<std::string>> m_words;
+};
+
+// Anagram classes of a dictionary laid out flat:
+// class i holds words[offsets[i]] .. words[offsets[i + 1] - 1], so offsets has one entry more than classes
+struct AnagramClasses
+{
+    std::vector<std::string> words;
+    std::vector<size_t> offsets;
+};
+
+template <typename Task>
+void RunOnThreads(size_t threads, Task task)
+{
+    std::vector<std::thread> workers;
+    for (size_t thread = 1; thread < threads; ++thread)
+    {
+        workers.emplace_back(task, thread);
+    }
+    task(0);
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+// Splits non-empty dictionary words into anagram classes.
+// Every thread signs a contiguous chunk of the dictionary and hands each word to a partition by signature hash,
+// then every thread groups one partition alone, so no class is shared between threads and nothing is locked.
+// Classes come in order of their first word in the dictionary, words of a class keep the dictionary order.
+AnagramClasses GroupAnagrams(const std::vector<std::string>& dictionary, size_t threads)
+{
+    const size_t count = dictionary.size();
+    // Partitions grow as threads squared, so never run more threads than words or cores
+    threads = std::min({threads, std::max<size_t>(count, 1), static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency()))});
+    threads = std::max<size_t>(threads, 1);
+
+    std::vector<std::string> signatures(count);
+    std::vector<std::vector<size_t>> partitions(threads * threads); // [thread * threads + partition]
+    RunOnThreads(threads, [&](size_t thread)
+    {
+        for (size_t index = count * thread / threads; index < count * (thread + 1) / threads; ++index)
+        {
+            if (!dictionary[index].empty())
+            {
+                signatures[index] = GetAnagramSignature(dictionary[index]);
+                const size_t partition = std::hash<std::string>()(signatures[index]) % threads;
+                partitions[thread * threads + partition].push_back(index);
+            }
+        }
+    });
+
+    // Chunks are visited in dictionary order, so classes are created by first word and fill up in order
+    std::vector<std::vector<std::vector<size_t>>> classes(threads);
+    RunOnThreads(threads, [&](size_t partition)
+    {
+        std::unordered_map<std::string, size_t> classBySignature;
+        for (size_t thread = 0; thread < threads; ++thread)
+        {
+            for (size_t index : partitions[thread * threads + partition])
+            {
+                auto found = classBySignature.emplace(signatures[index], classes[partition].size());
+                if (found.second)
+                {
+                    classes[partition].emplace_back();
+                }
+                classes[partition][found.first->second].push_back(index);
+            }
+        }
+    });
+
+    struct ClassRef
+    {
+        size_t firstIndex;
+        size_t partition;
+        size_t localClass;
+    };
+    std::vector<ClassRef> order;
+    for (size_t partition = 0; partition < threads; ++partition)
+    {
+        for (size_t localClass = 0; localClass < classes[partition].size(); ++localClass)
+        {
+            order.push_back({classes[partition][localClass].front(), partition, localClass});
+        }
+    }
+    std::sort(order.begin(), order.end(), [](const ClassRef& left, const ClassRef& right)
+    {
+        return left.firstIndex < right.firstIndex;
+    });
+
+    AnagramClasses result;
+    result.offsets.reserve(order.size() + 1);
+    result.offsets.push_back(0);
+    std::vector<std::vector<size_t>> starts(threads);
+    for (size_t partition = 0; partition < threads; ++partition)
+    {
+        starts[partition].resize(classes[partition].size());
+    }
+    for (const ClassRef& ref : order)
+    {
+        starts[ref.partition][ref.localClass] = result.offsets.back();
+        result.offsets.push_back(result.offsets.back() + classes[ref.partition][ref.localClass].size());
+    }
+
+    result.words.resize(result.offsets.back());
+    RunOnThreads(threads, [&](size_t partition)
+    {
+        for (size_t localClass = 0; localClass < classes[partition].size(); ++localClass)
+        {
+            size_t position = starts[partition][localClass];
+            for (size_t index : classes[partition][localClass])
+            {
+                result.words[position++] = dictionary[index];
+            }
+        }
+    });
+    return result;
+}
+
+// The straightforward definition IsAnagrams is checked against
+bool IsAnagramsBySort(std::string left, std::string right)
+{
+    if (left == right || left.empty() || right.empty())
+    {
+        return false;
+    }
+    std::sort (left.begin(), left.end());
+    std::sort (right.begin(), right.end());
+    return left == right;
+}
+
 TEST (IsAnagrams, empty_words)
 {
     EXPECT_FALSE(IsAnagrams("", ""));
@@ -49,6 +387,199 @@ TEST (IsAnagrams, anagrams_return_true)
     EXPECT_TRUE(IsAnagrams("listen", "inlets"));
 }
 
+TEST (IsAnagrams, different_length_return_false)
+{
+    EXPECT_FALSE(IsAnagrams("listen", "listens"));
+    EXPECT_FALSE(IsAnagrams("", "a"));
+}
+
+TEST (IsAnagrams, same_letters_different_counts_return_false)
+{
+    EXPECT_FALSE(IsAnagrams("aab", "abb"));
+}
+
+TEST (IsAnagrams, non_ascii_bytes)
+{
+    EXPECT_TRUE(IsAnagrams("\xFF\x01z", "z\xFF\x01"));
+    EXPECT_FALSE(IsAnagrams("\xFF\x01z", "z\xFE\x01"));
+}
+
+TEST (IsAnagrams, same_as_sort)
+{
+    unsigned int seed = 29;
+    const auto makeWord = [&seed](size_t length)
+    {
+        std::string word;
+        for (size_t i = 0; i < length; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            word += static_cast<char>('a' + (seed >> 16) % 3);
+        }
+        return word;
+    };
+
+    for (size_t length : {1, 2, 3, 5, 8, 64, 1000})
+    {
+        for (size_t i = 0; i < 200; ++i)
+        {
+            const std::string left = makeWord(length);
+            std::string right = i % 2 == 0 ? makeWord(length) : left;
+            std::reverse(right.begin(), right.end());
+            EXPECT_EQ(IsAnagramsBySort(left, right), IsAnagrams(left, right)) << left << " " << right;
+        }
+    }
+}
+
+// Benchmarks are disabled by default, run them with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+TEST (IsAnagramsBenchmark, DISABLED_histogram_against_sort)
+{
+    const size_t pairsCount = 1000;
+    unsigned int seed = 31;
+    for (size_t length : {6, 1000})
+    {
+        // Anagram pairs, so that neither version exits early
+        std::vector<std::pair<std::string, std::string>> pairs;
+        for (size_t i = 0; i < pairsCount; ++i)
+        {
+            std::string word;
+            for (size_t letter = 0; letter < length; ++letter)
+            {
+                seed = seed * 1103515245 + 12345;
+                word += static_cast<char>('a' + (seed >> 16) % 26);
+            }
+            std::string anagram = word;
+            std::rotate(anagram.begin(), anagram.begin() + 1, anagram.end());
+            pairs.emplace_back(word, anagram);
+        }
+
+        for (bool bySort : {false, true})
+        {
+            size_t anagrams = 0;
+            size_t rounds = 0;
+            const auto start = std::chrono::steady_clock::now();
+            std::chrono::duration<double> elapsed(0);
+            while (elapsed.count() < 0.5)
+            {
+                for (const std::pair<std::string, std::string>& pair : pairs)
+                {
+                    anagrams += bySort ? IsAnagramsBySort(pair.first, pair.second) : IsAnagrams(pair.first, pair.second);
+                }
+                ++rounds;
+                elapsed = std::chrono::steady_clock::now() - start;
+            }
+            std::cout << "[ MEASURED ] " << (bySort ? "IsAnagramsBySort" : "IsAnagrams") << ", " << length << " letters: "
+                      << rounds * pairsCount / elapsed.count() << " pairs/s" << std::endl;
+            EXPECT_GT(anagrams, 0u);
+        }
+    }
+}
+
+TEST (IsAnagrams, case_sensitive)
+{
+    EXPECT_FALSE(IsAnagrams("Listen", "Silent"));
+}
+
+TEST (IsAnagramsIgnoreCase, empty_words)
+{
+    EXPECT_FALSE(IsAnagramsIgnoreCase("", ""));
+    EXPECT_FALSE(IsAnagramsIgnoreCase("", "A"));
+}
+
+TEST (IsAnagramsIgnoreCase, different_case_anagrams_return_true)
+{
+    EXPECT_TRUE(IsAnagramsIgnoreCase("Listen", "Silent"));
+    EXPECT_TRUE(IsAnagramsIgnoreCase("LISTEN", "inlets"));
+}
+
+TEST (IsAnagramsIgnoreCase, same_word_in_other_case_return_false)
+{
+    EXPECT_FALSE(IsAnagramsIgnoreCase("Listen", "listen"));
+    EXPECT_FALSE(IsAnagramsIgnoreCase("word", "WORD"));
+}
+
+TEST (IsAnagramsIgnoreCase, only_letters_are_folded)
+{
+    EXPECT_FALSE(IsAnagramsIgnoreCase("@a", "a`"));
+    EXPECT_FALSE(IsAnagramsIgnoreCase("[b", "b{"));
+    EXPECT_TRUE(IsAnagramsIgnoreCase("A-1", "1a-"));
+}
+
+TEST (IsAnagramsIgnoreCase, latin_1)
+{
+    // "\xC3\x89" is E with acute, "\xC3\xA9" is its lower case
+    EXPECT_TRUE(IsAnagramsIgnoreCase(std::string("\xC3\x89") + "t", std::string("t") + "\xC3\xA9"));
+    EXPECT_FALSE(IsAnagramsIgnoreCase(std::string("\xC3\x89") + "t", std::string("\xC3\xA9") + "t"));
+    EXPECT_FALSE(IsAnagramsIgnoreCase(std::string("\xC3\xA9") + "t", "te"));
+}
+
+TEST (IsAnagramsIgnoreCase, cyrillic)
+{
+    // "\xD0\x9A\xD0\xBE\xD1\x82" and "\xD1\x82\xD0\xBE\xD0\xBA" are "cat" and "current" in Russian
+    EXPECT_TRUE(IsAnagramsIgnoreCase("\xD0\x9A\xD0\xBE\xD1\x82", "\xD1\x82\xD0\xBE\xD0\xBA"));
+    // "\xD0\x81" and "\xD1\x91" are the upper and lower case of one letter outside the main block
+    EXPECT_TRUE(IsAnagramsIgnoreCase("\xD0\x81\xD0\xB6", "\xD0\x96\xD1\x91"));
+    EXPECT_FALSE(IsAnagramsIgnoreCase("\xD0\x81\xD0\xB6", "\xD1\x91\xD0\x96"));
+}
+
+TEST (IsAnagramsIgnoreCase, greek_final_sigma)
+{
+    // "\xCF\x82" is final sigma, "\xCF\x83" is sigma and "\xCE\xA3" is their capital
+    EXPECT_TRUE(IsAnagramsIgnoreCase("\xCE\xB1\xCF\x82", "\xCF\x83\xCE\xB1"));
+    EXPECT_TRUE(IsAnagramsIgnoreCase("\xCE\xB1\xCF\x82", "\xCE\xA3\xCE\xB1"));
+    EXPECT_FALSE(IsAnagramsIgnoreCase("\xCE\xB1\xCF\x82", "\xCE\xB1\xCF\x83"));
+}
+
+TEST (IsAnagramsIgnoreCase, non_ascii_different_sizes)
+{
+    EXPECT_FALSE(IsAnagramsIgnoreCase("\xD0\x9A\xD0\xBE", "\xD0\xBE"));
+}
+
+TEST (IsAnagramsIgnoreCase, malformed_bytes_are_not_code_points)
+{
+    // Lone continuation byte against U+0080, overlong encoding of 'a' against 'a'
+    EXPECT_FALSE(IsAnagramsIgnoreCase("\x80" "ab", "b\xC2\x80"));
+    EXPECT_FALSE(IsAnagramsIgnoreCase("\xE0\x81\xA1" "b", "ba\xE0\x80"));
+}
+
+TEST (IsAnagramsIgnoreCase, malformed_utf8)
+{
+    EXPECT_TRUE(IsAnagramsIgnoreCase("\xFF\xC3" "A", "a\xC3\xFF"));
+    EXPECT_FALSE(IsAnagramsIgnoreCase("\xFF" "A", "a\xFE"));
+}
+
+TEST (IsAnagramsIgnoreCase, same_as_lower_case_for_ascii)
+{
+    unsigned int seed = 53;
+    const auto makeWord = [&seed]()
+    {
+        std::string word;
+        for (size_t i = 0; i < 6; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            word += "abcABC"[(seed >> 16) % 6];
+        }
+        return word;
+    };
+    const auto toLower = [](std::string word)
+    {
+        std::transform(word.begin(), word.end(), word.begin(), [](char c) {return static_cast<char>(std::tolower(c));});
+        return word;
+    };
+
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        const std::string left = makeWord();
+        const std::string right = makeWord();
+        EXPECT_EQ(IsAnagramsBySort(toLower(left), toLower(right)), IsAnagramsIgnoreCase(left, right)) << left << " " << right;
+    }
+}
+
+TEST (GetAnagramsIgnoreCase, acceptance)
+{
+    EXPECT_EQ(Anagrams({"Inlets", "Silent"}),
+              GetAnagramsIgnoreCase("Listen", {"Enlists", "google", "Inlets", "banana", "Silent", "LISTEN"}));
+}
+
 TEST (GetAnagrams, empty_list_empty_word)
 {
     EXPECT_EQ(Anagrams(), GetAnagrams("", std::vector<std::string>()));
@@ -73,3 +604,141 @@ TEST (GetAnagrams, acceptance)
 {
     EXPECT_EQ(Anagrams({"inlets"}), GetAnagrams("listen", {"enlists", "google", "inlets", "banana"}));
 }
+
+TEST (AnagramIndex, empty_dictionary)
+{
+    EXPECT_EQ(Anagrams(), AnagramIndex(std::vector<std::string>()).GetAnagrams("listen"));
+}
+
+TEST (AnagramIndex, empty_word)
+{
+    EXPECT_EQ(Anagrams(), AnagramIndex({"", "abc"}).GetAnagrams(""));
+}
+
+TEST (AnagramIndex, same_word_is_not_anagram)
+{
+    EXPECT_EQ(Anagrams({"cba"}), AnagramIndex({"abc", "cba"}).GetAnagrams("abc"));
+}
+
+TEST (AnagramIndex, word_missing_in_dictionary)
+{
+    EXPECT_EQ(Anagrams({"acb", "cba"}), AnagramIndex({"acb", "cba", "cab ", "ab"}).GetAnagrams("bca"));
+}
+
+TEST (AnagramIndex, acceptance)
+{
+    const AnagramIndex index({"enlists", "google", "inlets", "banana", "silent", "tinsel"});
+    EXPECT_EQ(Anagrams({"inlets", "silent", "tinsel"}), index.GetAnagrams("listen"));
+    EXPECT_EQ(Anagrams({"inlets", "tinsel"}), index.GetAnagrams("silent"));
+    EXPECT_EQ(Anagrams(), index.GetAnagrams("banana"));
+}
+
+TEST (AnagramIndex, same_as_get_anagrams)
+{
+    std::vector<std::string> dictionary;
+    unsigned int seed = 17;
+    for (size_t i = 0; i < 5000; ++i)
+    {
+        std::string word;
+        for (size_t letter = 0; letter < 1 + i % 4; ++letter)
+        {
+            seed = seed * 1103515245 + 12345;
+            word += static_cast<char>('a' + (seed >> 16) % 4);
+        }
+        dictionary.push_back(word);
+    }
+
+    const AnagramIndex index(dictionary);
+    for (const char* word : {"a", "ab", "abc", "dcba", "aabb", "ddd", "abcde"})
+    {
+        EXPECT_EQ(GetAnagrams(word, dictionary), index.GetAnagrams(word));
+    }
+}
+
+std::vector<std::vector<std::string>> GetClassesList(const AnagramClasses& classes)
+{
+    std::vector<std::vector<std::string>> list;
+    for (size_t i = 0; i + 1 < classes.offsets.size(); ++i)
+    {
+        list.emplace_back(classes.words.begin() + classes.offsets[i], classes.words.begin() + classes.offsets[i + 1]);
+    }
+    return list;
+}
+
+TEST (GroupAnagrams, empty_dictionary)
+{
+    const AnagramClasses classes = GroupAnagrams(std::vector<std::string>(), 4);
+    EXPECT_TRUE(classes.words.empty());
+    EXPECT_EQ(std::vector<size_t>({0}), classes.offsets);
+}
+
+TEST (GroupAnagrams, empty_words_are_skipped)
+{
+    const AnagramClasses classes = GroupAnagrams({"", "ab", "", "ba"}, 1);
+    EXPECT_EQ(std::vector<std::string>({"ab", "ba"}), classes.words);
+    EXPECT_EQ(std::vector<size_t>({0, 2}), classes.offsets);
+}
+
+TEST (GroupAnagrams, duplicates_stay_in_class)
+{
+    EXPECT_EQ(std::vector<std::vector<std::string>>({{"abc", "cab", "abc"}, {"x"}}),
+              GetClassesList(GroupAnagrams({"abc", "cab", "x", "abc"}, 2)));
+}
+
+TEST (GroupAnagrams, acceptance)
+{
+    const std::vector<std::string> dictionary = {"listen", "google", "inlets", "banana", "silent", "elgoog"};
+    const std::vector<std::vector<std::string>> expected =
+        {{"listen", "inlets", "silent"}, {"google", "elgoog"}, {"banana"}};
+    for (size_t threads : {0, 1, 2, 3, 16})
+    {
+        EXPECT_EQ(expected, GetClassesList(GroupAnagrams(dictionary, threads))) << threads;
+    }
+}
+
+TEST (GroupAnagrams, same_for_any_threads_count)
+{
+    std::vector<std::string> dictionary;
+    unsigned int seed = 41;
+    for (size_t i = 0; i < 20000; ++i)
+    {
+        std::string word;
+        for (size_t letter = 0; letter < i % 6; ++letter)
+        {
+            seed = seed * 1103515245 + 12345;
+            word += static_cast<char>('a' + (seed >> 16) % 5);
+        }
+        dictionary.push_back(word);
+    }
+
+    const AnagramClasses single = GroupAnagrams(dictionary, 1);
+    EXPECT_EQ(dictionary.size() - dictionary.size() / 6 - (dictionary.size() % 6 != 0), single.words.size());
+
+    const AnagramIndex index(dictionary);
+    std::set<std::string> seenSignatures;
+    for (size_t i = 0; i + 1 < single.offsets.size(); ++i)
+    {
+        const std::string& first = single.words[single.offsets[i]];
+        EXPECT_TRUE(seenSignatures.insert(GetAnagramSignature(first)).second);
+        Anagrams group(single.words.begin() + single.offsets[i] + 1, single.words.begin() + single.offsets[i + 1]);
+        group.erase(first);
+        EXPECT_EQ(index.GetAnagrams(first), group);
+    }
+
+    for (size_t threads : {2, 3, 8})
+    {
+        const AnagramClasses parallel = GroupAnagrams(dictionary, threads);
+        EXPECT_EQ(single.words, parallel.words) << threads;
+        EXPECT_EQ(single.offsets, parallel.offsets) << threads;
+    }
+}
+
+TEST (GroupAnagrams, huge_threads_count_on_tiny_dictionary)
+{
+    const std::vector<std::string> dictionary = {"listen", "silent", "", "enlist", "google", "banana", "inlets", "elgoog", "tinsel", "b"};
+    const AnagramClasses single = GroupAnagrams(dictionary, 1);
+    const AnagramClasses parallel = GroupAnagrams(dictionary, 1000000);
+    EXPECT_EQ(single.words, parallel.words);
+    EXPECT_EQ(single.offsets, parallel.offsets);
+    EXPECT_EQ(std::vector<size_t>({0, 5, 7, 8, 9}), parallel.offsets);
+}
@@ -1,9 +1,14 @@
 include(../../gmock.pri)
 
 TEMPLATE = app
-CONFIG += console c++11
+CONFIG += console c++11 thread
 CONFIG -= app_bundle
 CONFIG -= qt
 
+HEADERS += \
+    weather_server.h
+
 SOURCES += \
     test.cpp
+
+win32: LIBS += -lws2_32
@@ -46,6 +46,43 @@ IMPORTANT:
 
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// IWeatherServer with its fake and load testing implementations, shared with the weather_server process
+#include "weather_server.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 struct Weather
 {
@@ -60,14 +97,6 @@ struct Weather
     }
 };
 
-class IWeatherServer
-{
-public:
-    virtual ~IWeatherServer() { }
-    // Returns raw response with weather for the given day and time in request
-    virtual std::string GetWeather(const std::string& request) = 0;
-};
-
 // Implement this interface
 class IWeatherClient
 {
@@ -79,3 +108,1490 @@ public:
     virtual double GetAverageWindDirection(IWeatherServer& server, const std::string& date) = 0;
     virtual double GetMaximumWindSpeed(IWeatherServer& server, const std::string& date) = 0;
 };
+
+const size_t s_slotsPerDay = 4;
+const char* const s_slotTimes[s_slotsPerDay] = {"03:00", "09:00", "15:00", "21:00"};
+
+// Packed "<date>;<time>" request: days since 01.01.1970 multiplied by s_slotsPerDay plus index of the time
+struct WeatherKey
+{
+    uint32_t value = 0;
+
+    WeatherKey()
+    {
+    }
+    WeatherKey(uint32_t day, uint32_t slot) : value(day * s_slotsPerDay + slot)
+    {
+    }
+    uint32_t GetDay() const
+    {
+        return value / s_slotsPerDay;
+    }
+    uint32_t GetSlot() const
+    {
+        return value % s_slotsPerDay;
+    }
+    bool operator==(const WeatherKey& right) const
+    {
+        return value == right.value;
+    }
+};
+
+namespace
+{
+    bool ParseTwoDigits(const char* text, unsigned int& value)
+    {
+        if (text[0] < '0' || text[0] > '9' || text[1] < '0' || text[1] > '9')
+        {
+            return false;
+        }
+        value = (text[0] - '0') * 10 + (text[1] - '0');
+        return true;
+    }
+
+    // Howard Hinnant's days_from_civil, months are 1-12
+    uint32_t DaysFromCivil(unsigned int year, unsigned int month, unsigned int day)
+    {
+        year -= month <= 2;
+        const unsigned int era = year / 400;
+        const unsigned int yearOfEra = year - era * 400;
+        const unsigned int dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        const unsigned int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return era * 146097 + dayOfEra - 719468;
+    }
+
+    void CivilFromDays(uint32_t days, unsigned int& year, unsigned int& month, unsigned int& day)
+    {
+        days += 719468;
+        const unsigned int era = days / 146097;
+        const unsigned int dayOfEra = days - era * 146097;
+        const unsigned int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        const unsigned int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        const unsigned int shiftedMonth = (5 * dayOfYear + 2) / 153;
+        day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+        month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+        year = yearOfEra + era * 400 + (month <= 2);
+    }
+}
+
+// Parses "dd.mm.yyyy" into days since 01.01.1970
+bool ParseDate(const char* date, size_t size, uint32_t& days)
+{
+    unsigned int day = 0;
+    unsigned int month = 0;
+    unsigned int century = 0;
+    unsigned int year = 0;
+    if (size != 10 || date[2] != '.' || date[5] != '.' ||
+        !ParseTwoDigits(&date[0], day) || !ParseTwoDigits(&date[3], month) ||
+        !ParseTwoDigits(&date[6], century) || !ParseTwoDigits(&date[8], year))
+    {
+        return false;
+    }
+
+    year += century * 100;
+    const unsigned int daysInMonth[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    const bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+    if (year < 1970 || month < 1 || month > 12 || day < 1 ||
+        day > daysInMonth[month - 1] + (month == 2 && leap))
+    {
+        return false;
+    }
+
+    days = DaysFromCivil(year, month, day);
+    return true;
+}
+
+bool ParseDate(const std::string& date, uint32_t& days)
+{
+    return ParseDate(date.data(), date.size(), days);
+}
+
+// Parses "<date>;<time>" request, accepts only the times the server stores weather for
+bool ParseWeatherKey(const std::string& request, WeatherKey& key)
+{
+    uint32_t day = 0;
+    if (request.size() != 16 || request[10] != ';' || !ParseDate(request.data(), 10, day))
+    {
+        return false;
+    }
+
+    for (uint32_t slot = 0; slot < s_slotsPerDay; ++slot)
+    {
+        if (request.compare(11, 5, s_slotTimes[slot]) == 0)
+        {
+            key = WeatherKey(day, slot);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string FormatDate(uint32_t days)
+{
+    unsigned int year = 0;
+    unsigned int month = 0;
+    unsigned int day = 0;
+    CivilFromDays(days, year, month, day);
+
+    char date[32];
+    std::snprintf(date, sizeof(date), "%02u.%02u.%04u", day, month, year);
+    return date;
+}
+
+std::string FormatWeatherKey(WeatherKey key)
+{
+    return FormatDate(key.GetDay()) + ";" + s_slotTimes[key.GetSlot()];
+}
+
+// Lets callers address the string based server by packed keys
+class KeyedWeatherServer
+{
+public:
+    explicit KeyedWeatherServer(IWeatherServer& server) : m_server(server)
+    {
+    }
+
+    std::string GetWeather(WeatherKey key)
+    {
+        return m_server.GetWeather(FormatWeatherKey(key));
+    }
+
+private:
+    IWeatherServer& m_server;
+};
+
+class MockWeatherServer : public IWeatherServer
+{
+public:
+    MOCK_METHOD1(GetWeather, std::string(const std::string&));
+};
+
+// Parses "<temperature>;<wind_direction>;<wind_speed>", returns false for malformed responses
+bool ParseWeather(const std::string& response, Weather& weather)
+{
+    const char* cur = response.c_str();
+    char* end = nullptr;
+
+    const long temperature = std::strtol(cur, &end, 10);
+    if (end == cur || *end != ';')
+    {
+        return false;
+    }
+    cur = end + 1;
+
+    const long windDirection = std::strtol(cur, &end, 10);
+    if (end == cur || *end != ';' || windDirection < 0 || windDirection > 359)
+    {
+        return false;
+    }
+    cur = end + 1;
+
+    const double windSpeed = std::strtod(cur, &end);
+    if (end == cur || *end != '\0')
+    {
+        return false;
+    }
+
+    weather.temperature = static_cast<short>(temperature);
+    weather.windDirection = static_cast<unsigned short>(windDirection);
+    weather.windSpeed = windSpeed;
+    return true;
+}
+
+const unsigned short s_degreesInCircle = 360;
+
+// Unit vectors of all possible wind directions, wind direction is always a whole number of degrees
+struct DirectionVectors
+{
+    double sin[s_degreesInCircle];
+    double cos[s_degreesInCircle];
+
+    DirectionVectors()
+    {
+        const double radiansInDegree = std::atan(1.0) / 45;
+        for (unsigned short degree = 0; degree < s_degreesInCircle; ++degree)
+        {
+            sin[degree] = std::sin(degree * radiansInDegree);
+            cos[degree] = std::cos(degree * radiansInDegree);
+        }
+    }
+};
+
+const DirectionVectors& GetDirectionVectors()
+{
+    static const DirectionVectors s_vectors;
+    return s_vectors;
+}
+
+// Direction of the sum of unit vectors of getDirection(i) for i in [0, count), in [0, 360).
+// Returns 0 when the directions cancel each other out.
+template<typename DirectionGetter>
+double GetCircularMeanOf(size_t count, DirectionGetter getDirection)
+{
+    const DirectionVectors& vectors = GetDirectionVectors();
+
+    double sinSum = 0;
+    double cosSum = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const unsigned short direction = getDirection(i) % s_degreesInCircle;
+        sinSum += vectors.sin[direction];
+        cosSum += vectors.cos[direction];
+    }
+
+    const double cancelledOut = 1e-9;
+    if (std::abs(sinSum) < cancelledOut && std::abs(cosSum) < cancelledOut)
+    {
+        return 0;
+    }
+
+    double mean = std::atan2(sinSum, cosSum) * 45 / std::atan(1.0);
+    if (mean < 0)
+    {
+        mean += s_degreesInCircle;
+    }
+    return mean < s_degreesInCircle ? mean : 0;
+}
+
+// Mean wind direction, so the mean of 359 and 1 is 0 rather than 180
+double GetCircularMean(const unsigned short* directions, size_t count)
+{
+    return GetCircularMeanOf(count, [directions](size_t i) {return directions[i];});
+}
+
+// Same as above, reads directions right out of the readings
+double GetCircularMean(const Weather* readings, size_t count)
+{
+    return GetCircularMeanOf(count, [readings](size_t i) {return readings[i].windDirection;});
+}
+
+// Weather stored field by field: every field lives in its own contiguous array,
+// so statistics over any range of rows are plain loops
+struct WeatherColumns
+{
+    const short* temperatures = nullptr;
+    const unsigned short* windDirections = nullptr;
+    const double* windSpeeds = nullptr;
+    size_t rows = 0;
+
+    Weather Get(size_t row) const
+    {
+        Weather weather;
+        weather.temperature = temperatures[row];
+        weather.windDirection = windDirections[row];
+        weather.windSpeed = windSpeeds[row];
+        return weather;
+    }
+
+    double GetAverageTemperature(size_t firstRow, size_t count) const
+    {
+        long sum = 0;
+        for (size_t row = firstRow; row < firstRow + count; ++row)
+        {
+            sum += temperatures[row];
+        }
+        return static_cast<double>(sum) / count;
+    }
+
+    double GetMinimumTemperature(size_t firstRow, size_t count) const
+    {
+        return *std::min_element(temperatures + firstRow, temperatures + firstRow + count);
+    }
+
+    double GetMaximumTemperature(size_t firstRow, size_t count) const
+    {
+        return *std::max_element(temperatures + firstRow, temperatures + firstRow + count);
+    }
+
+    double GetAverageWindDirection(size_t firstRow, size_t count) const
+    {
+        return GetCircularMean(windDirections + firstRow, count);
+    }
+
+    double GetMaximumWindSpeed(size_t firstRow, size_t count) const
+    {
+        return *std::max_element(windSpeeds + firstRow, windSpeeds + firstRow + count);
+    }
+};
+
+// Weather history file, all numbers are in the byte order of the machine:
+// "WHC1", count of dates (uint32_t), the dates as days since 01.01.1970 (uint32_t) in order of their rows,
+// then the columns of s_slotsPerDay rows per date: temperatures (int16_t), wind directions (uint16_t)
+// and wind speeds (double) aligned to 8 bytes, so every column can be used right from a mapped file.
+struct WeatherFileLayout
+{
+    static const size_t s_headerSize = 8;
+
+    size_t dates;
+    size_t rows;
+    size_t temperatures;
+    size_t windDirections;
+    size_t windSpeeds;
+    size_t size;
+
+    explicit WeatherFileLayout(size_t datesCount)
+        : dates(datesCount)
+        , rows(datesCount * s_slotsPerDay)
+        , temperatures(s_headerSize + datesCount * sizeof(uint32_t))
+        , windDirections(temperatures + rows * sizeof(short))
+        , windSpeeds((windDirections + rows * sizeof(unsigned short) + 7) / 8 * 8)
+        , size(windSpeeds + rows * sizeof(double))
+    {
+    }
+};
+
+const char s_weatherFileMagic[4] = {'W', 'H', 'C', '1'};
+
+// Local columnar copy of the server data: every date occupies s_slotsPerDay consecutive rows.
+// Can be saved to a file to be read later through MappedWeatherHistory.
+class WeatherHistory
+{
+public:
+    // Fetches all slots of the date unless they are already stored, returns the first row of the date
+    size_t Load(IWeatherServer& server, const std::string& date)
+    {
+        uint32_t days = 0;
+        if (!ParseDate(date, days))
+        {
+            throw std::runtime_error("Invalid date " + date);
+        }
+
+        auto stored = m_dayRows.find(days);
+        if (stored != m_dayRows.end())
+        {
+            return stored->second;
+        }
+
+        KeyedWeatherServer keyedServer(server);
+        Weather day[s_slotsPerDay];
+        for (uint32_t slot = 0; slot < s_slotsPerDay; ++slot)
+        {
+            const WeatherKey key(days, slot);
+            if (!ParseWeather(keyedServer.GetWeather(key), day[slot]))
+            {
+                throw std::runtime_error("No weather for " + FormatWeatherKey(key));
+            }
+        }
+
+        const size_t firstRow = Size();
+        for (const Weather& weather : day)
+        {
+            m_temperatures.push_back(weather.temperature);
+            m_windDirections.push_back(weather.windDirection);
+            m_windSpeeds.push_back(weather.windSpeed);
+        }
+        m_dayRows[days] = firstRow;
+        m_days.push_back(days);
+        return firstRow;
+    }
+
+    size_t Size() const
+    {
+        return m_temperatures.size();
+    }
+
+    // Valid until the next Load
+    WeatherColumns GetColumns() const
+    {
+        WeatherColumns columns;
+        columns.temperatures = m_temperatures.data();
+        columns.windDirections = m_windDirections.data();
+        columns.windSpeeds = m_windSpeeds.data();
+        columns.rows = Size();
+        return columns;
+    }
+
+    Weather Get(size_t row) const
+    {
+        return GetColumns().Get(row);
+    }
+
+    double GetAverageTemperature(size_t firstRow, size_t count) const
+    {
+        return GetColumns().GetAverageTemperature(firstRow, count);
+    }
+
+    double GetMinimumTemperature(size_t firstRow, size_t count) const
+    {
+        return GetColumns().GetMinimumTemperature(firstRow, count);
+    }
+
+    double GetMaximumTemperature(size_t firstRow, size_t count) const
+    {
+        return GetColumns().GetMaximumTemperature(firstRow, count);
+    }
+
+    double GetAverageWindDirection(size_t firstRow, size_t count) const
+    {
+        return GetColumns().GetAverageWindDirection(firstRow, count);
+    }
+
+    double GetMaximumWindSpeed(size_t firstRow, size_t count) const
+    {
+        return GetColumns().GetMaximumWindSpeed(firstRow, count);
+    }
+
+    // Writes all stored dates in the WeatherFileLayout format, replacing the file
+    void Save(const std::string& path) const
+    {
+        const WeatherFileLayout layout(m_days.size());
+        std::vector<char> data(layout.size, 0);
+        const uint32_t dates = static_cast<uint32_t>(layout.dates);
+        std::memcpy(&data[0], s_weatherFileMagic, sizeof(s_weatherFileMagic));
+        std::memcpy(&data[sizeof(s_weatherFileMagic)], &dates, sizeof(dates));
+        if (layout.rows != 0)
+        {
+            std::memcpy(&data[WeatherFileLayout::s_headerSize], m_days.data(), layout.dates * sizeof(uint32_t));
+            std::memcpy(&data[layout.temperatures], m_temperatures.data(), layout.rows * sizeof(short));
+            std::memcpy(&data[layout.windDirections], m_windDirections.data(), layout.rows * sizeof(unsigned short));
+            std::memcpy(&data[layout.windSpeeds], m_windSpeeds.data(), layout.rows * sizeof(double));
+        }
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.write(data.data(), static_cast<std::streamsize>(data.size())) || !file.flush())
+        {
+            throw std::runtime_error("Can not write weather history to " + path);
+        }
+    }
+
+private:
+    std::unordered_map<uint32_t, size_t> m_dayRows;
+    std::vector<uint32_t> m_days;
+    std::vector<short> m_temperatures;
+    std::vector<unsigned short> m_windDirections;
+    std::vector<double> m_windSpeeds;
+};
+
+// Read only mapping of a whole file into memory
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& path)
+    {
+#if defined(_WIN32)
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+        if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size))
+        {
+            Close();
+            throw std::runtime_error("Can not open " + path);
+        }
+        m_size = static_cast<size_t>(size.QuadPart);
+        if (m_size != 0)
+        {
+            m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            m_data = m_mapping != nullptr ? static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+        }
+#else
+        m_file = open(path.c_str(), O_RDONLY);
+        struct stat status;
+        if (m_file < 0 || fstat(m_file, &status) != 0)
+        {
+            Close();
+            throw std::runtime_error("Can not open " + path);
+        }
+        m_size = static_cast<size_t>(status.st_size);
+        if (m_size != 0)
+        {
+            void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_file, 0);
+            m_data = data != MAP_FAILED ? static_cast<const char*>(data) : nullptr;
+        }
+#endif
+        if (m_size != 0 && m_data == nullptr)
+        {
+            Close();
+            throw std::runtime_error("Can not map " + path);
+        }
+    }
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* Data() const
+    {
+        return m_data;
+    }
+
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+private:
+    void Close()
+    {
+#if defined(_WIN32)
+        if (m_data != nullptr)
+        {
+            UnmapViewOfFile(m_data);
+        }
+        if (m_mapping != nullptr)
+        {
+            CloseHandle(m_mapping);
+        }
+        if (m_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_file);
+        }
+        m_mapping = nullptr;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if (m_data != nullptr)
+        {
+            munmap(const_cast<char*>(m_data), m_size);
+        }
+        if (m_file >= 0)
+        {
+            close(m_file);
+        }
+        m_file = -1;
+#endif
+        m_data = nullptr;
+    }
+
+private:
+#if defined(_WIN32)
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+// Weather history saved by WeatherHistory::Save, columns are read right from the mapped file
+class MappedWeatherHistory
+{
+public:
+    explicit MappedWeatherHistory(const std::string& path) : m_file(path)
+    {
+        uint32_t dates = 0;
+        if (m_file.Size() < WeatherFileLayout::s_headerSize ||
+            std::memcmp(m_file.Data(), s_weatherFileMagic, sizeof(s_weatherFileMagic)) != 0)
+        {
+            throw std::runtime_error("Not a weather history file " + path);
+        }
+        std::memcpy(&dates, m_file.Data() + sizeof(s_weatherFileMagic), sizeof(dates));
+
+        const WeatherFileLayout layout(dates);
+        if (m_file.Size() != layout.size)
+        {
+            throw std::runtime_error("Truncated weather history file " + path);
+        }
+
+        const char* data = m_file.Data();
+        for (size_t date = 0; date < layout.dates; ++date)
+        {
+            uint32_t days = 0;
+            std::memcpy(&days, data + WeatherFileLayout::s_headerSize + date * sizeof(uint32_t), sizeof(days));
+            m_dayRows[days] = date * s_slotsPerDay;
+        }
+        m_columns.temperatures = reinterpret_cast<const short*>(data + layout.temperatures);
+        m_columns.windDirections = reinterpret_cast<const unsigned short*>(data + layout.windDirections);
+        m_columns.windSpeeds = reinterpret_cast<const double*>(data + layout.windSpeeds);
+        m_columns.rows = layout.rows;
+    }
+
+    // Finds the first row of the date, returns false for invalid or missing dates
+    bool FindDate(const std::string& date, size_t& firstRow) const
+    {
+        uint32_t days = 0;
+        auto stored = ParseDate(date, days) ? m_dayRows.find(days) : m_dayRows.end();
+        if (stored == m_dayRows.end())
+        {
+            return false;
+        }
+        firstRow = stored->second;
+        return true;
+    }
+
+    size_t Size() const
+    {
+        return m_columns.rows;
+    }
+
+    const WeatherColumns& GetColumns() const
+    {
+        return m_columns;
+    }
+
+private:
+    MappedFile m_file;
+    std::unordered_map<uint32_t, size_t> m_dayRows;
+    WeatherColumns m_columns;
+};
+
+// Takes dates from the archive when it has them, asks the server only for other dates it has not seen yet,
+// so it is expected to be used with one server
+class WeatherClient : public IWeatherClient
+{
+public:
+    explicit WeatherClient(const MappedWeatherHistory* archive = nullptr) : m_archive(archive)
+    {
+    }
+
+    double GetAverageTemperature(IWeatherServer& server, const std::string& date) override
+    {
+        size_t firstRow = 0;
+        return GetDate(server, date, firstRow).GetAverageTemperature(firstRow, s_slotsPerDay);
+    }
+    double GetMinimumTemperature(IWeatherServer& server, const std::string& date) override
+    {
+        size_t firstRow = 0;
+        return GetDate(server, date, firstRow).GetMinimumTemperature(firstRow, s_slotsPerDay);
+    }
+    double GetMaximumTemperature(IWeatherServer& server, const std::string& date) override
+    {
+        size_t firstRow = 0;
+        return GetDate(server, date, firstRow).GetMaximumTemperature(firstRow, s_slotsPerDay);
+    }
+    double GetAverageWindDirection(IWeatherServer& server, const std::string& date) override
+    {
+        size_t firstRow = 0;
+        return GetDate(server, date, firstRow).GetAverageWindDirection(firstRow, s_slotsPerDay);
+    }
+    double GetMaximumWindSpeed(IWeatherServer& server, const std::string& date) override
+    {
+        size_t firstRow = 0;
+        return GetDate(server, date, firstRow).GetMaximumWindSpeed(firstRow, s_slotsPerDay);
+    }
+
+private:
+    WeatherColumns GetDate(IWeatherServer& server, const std::string& date, size_t& firstRow)
+    {
+        if (m_archive != nullptr && m_archive->FindDate(date, firstRow))
+        {
+            return m_archive->GetColumns();
+        }
+        firstRow = m_history.Load(server, date);
+        return m_history.GetColumns();
+    }
+
+private:
+    const MappedWeatherHistory* m_archive;
+    WeatherHistory m_history;
+};
+
+// Lets concurrent identical requests share a single call to the wrapped server
+class SingleFlightWeatherServer : public IWeatherServer
+{
+public:
+    explicit SingleFlightWeatherServer(IWeatherServer& server) : m_server(server)
+    {
+    }
+
+    std::string GetWeather(const std::string& request) override
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto inFlight = m_inFlight.find(request);
+        if (inFlight != m_inFlight.end())
+        {
+            std::shared_future<std::string> response = inFlight->second;
+            ++m_waiters;
+            lock.unlock();
+            try
+            {
+                std::string result = response.get();
+                --m_waiters;
+                return result;
+            }
+            catch (...)
+            {
+                --m_waiters;
+                throw;
+            }
+        }
+
+        std::promise<std::string> promise;
+        m_inFlight[request] = promise.get_future().share();
+        lock.unlock();
+
+        std::string response;
+        try
+        {
+            response = m_server.GetWeather(request);
+        }
+        catch (...)
+        {
+            Finish(request);
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+        Finish(request);
+        promise.set_value(response);
+        return response;
+    }
+
+    // Number of callers waiting for a call started by another caller
+    size_t GetWaiters() const
+    {
+        return m_waiters;
+    }
+
+private:
+    // Requests arriving after this point start a new call instead of reusing a finished one
+    void Finish(const std::string& request)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_inFlight.erase(request);
+    }
+
+private:
+    IWeatherServer& m_server;
+    std::mutex m_mutex;
+    std::map<std::string, std::shared_future<std::string>> m_inFlight;
+    std::atomic<size_t> m_waiters{0};
+};
+
+TEST(FakeWeatherServer, ReturnsRecordedResponse)
+{
+    FakeWeatherServer server;
+    EXPECT_EQ("20;181;5.1", server.GetWeather("31.08.2018;03:00"));
+    EXPECT_EQ("27;299;4.0", server.GetWeather("02.09.2018;21:00"));
+}
+
+TEST(FakeWeatherServer, ReturnsEmptyStringForInvalidRequest)
+{
+    FakeWeatherServer server;
+    EXPECT_EQ("", server.GetWeather("31.08.2018;04:00"));
+    EXPECT_EQ("", server.GetWeather("garbage"));
+}
+
+TEST(ParseWeather, ParsesResponse)
+{
+    Weather expected;
+    expected.temperature = 20;
+    expected.windDirection = 181;
+    expected.windSpeed = 5.1;
+
+    Weather weather;
+    ASSERT_TRUE(ParseWeather("20;181;5.1", weather));
+    EXPECT_TRUE(expected == weather);
+}
+
+TEST(ParseWeather, ParsesNegativeTemperature)
+{
+    Weather weather;
+    ASSERT_TRUE(ParseWeather("-7;0;1.5", weather));
+    EXPECT_EQ(-7, weather.temperature);
+}
+
+TEST(ParseWeather, RejectsMalformedResponses)
+{
+    Weather weather;
+    EXPECT_FALSE(ParseWeather("", weather));
+    EXPECT_FALSE(ParseWeather("20;181", weather));
+    EXPECT_FALSE(ParseWeather("20;360;5.1", weather));
+    EXPECT_FALSE(ParseWeather("20;181;5.1x", weather));
+}
+
+TEST(ParseDate, DaysSinceEpoch)
+{
+    uint32_t days = 0;
+    ASSERT_TRUE(ParseDate("01.01.1970", days));
+    EXPECT_EQ(0u, days);
+    ASSERT_TRUE(ParseDate("31.08.2018", days));
+    EXPECT_EQ(17774u, days);
+    ASSERT_TRUE(ParseDate("29.02.2016", days));
+    ASSERT_TRUE(ParseDate("29.02.2000", days));
+}
+
+TEST(ParseDate, PrefixOfRequest)
+{
+    uint32_t days = 0;
+    ASSERT_TRUE(ParseDate("01.09.2018;03:00", 10, days));
+    EXPECT_EQ(17775u, days);
+    EXPECT_FALSE(ParseDate("01.09.2018;03:00", 11, days));
+}
+
+TEST(ParseDate, RejectsInvalidDates)
+{
+    uint32_t days = 0;
+    EXPECT_FALSE(ParseDate("", days));
+    EXPECT_FALSE(ParseDate("31.8.2018", days));
+    EXPECT_FALSE(ParseDate("31/08/2018", days));
+    EXPECT_FALSE(ParseDate("32.08.2018", days));
+    EXPECT_FALSE(ParseDate("00.08.2018", days));
+    EXPECT_FALSE(ParseDate("01.13.2018", days));
+    EXPECT_FALSE(ParseDate("29.02.2018", days));
+    EXPECT_FALSE(ParseDate("29.02.1900", days));
+    EXPECT_FALSE(ParseDate("31.12.1969", days));
+}
+
+TEST(WeatherKey, ParsesRequest)
+{
+    WeatherKey key;
+    ASSERT_TRUE(ParseWeatherKey("31.08.2018;03:00", key));
+    EXPECT_EQ(17774u * 4, key.value);
+    ASSERT_TRUE(ParseWeatherKey("01.09.2018;21:00", key));
+    EXPECT_EQ(17775u, key.GetDay());
+    EXPECT_EQ(3u, key.GetSlot());
+}
+
+TEST(WeatherKey, RejectsInvalidRequests)
+{
+    WeatherKey key;
+    EXPECT_FALSE(ParseWeatherKey("31.08.2018;04:00", key));
+    EXPECT_FALSE(ParseWeatherKey("31.08.2018 03:00", key));
+    EXPECT_FALSE(ParseWeatherKey("31.08.2018;03:00:00", key));
+    EXPECT_FALSE(ParseWeatherKey("32.08.2018;03:00", key));
+}
+
+TEST(WeatherKey, FormatsRequest)
+{
+    EXPECT_EQ("31.08.2018;03:00", FormatWeatherKey(WeatherKey(17774, 0)));
+    EXPECT_EQ("01.09.2018;15:00", FormatWeatherKey(WeatherKey(17775, 2)));
+}
+
+TEST(WeatherKey, RoundTrip)
+{
+    for (uint32_t value = 0; value < 200000; value += 7)
+    {
+        WeatherKey key;
+        key.value = value;
+        WeatherKey parsed;
+        ASSERT_TRUE(ParseWeatherKey(FormatWeatherKey(key), parsed));
+        ASSERT_EQ(value, parsed.value);
+    }
+}
+
+TEST(KeyedWeatherServer, GetWeather)
+{
+    FakeWeatherServer fake;
+    KeyedWeatherServer server(fake);
+    EXPECT_EQ("34;258;3.7", server.GetWeather(WeatherKey(17776, 2)));
+}
+
+TEST(WeatherHistory, ThrowsForInvalidDate)
+{
+    FakeWeatherServer server;
+    WeatherHistory history;
+    EXPECT_THROW(history.Load(server, "31.02.2018"), std::runtime_error);
+}
+
+TEST(WeatherHistory, StoresDateAsConsecutiveRows)
+{
+    FakeWeatherServer server;
+    WeatherHistory history;
+
+    EXPECT_EQ(0u, history.Load(server, "31.08.2018"));
+    EXPECT_EQ(4u, history.Load(server, "01.09.2018"));
+    EXPECT_EQ(8u, history.Size());
+    EXPECT_EQ(22, history.Get(5).temperature);
+    EXPECT_EQ(131, history.Get(5).windDirection);
+}
+
+TEST(WeatherHistory, AsksServerOnlyOncePerSlot)
+{
+    FakeWeatherServer fake;
+    MockWeatherServer server;
+    WeatherHistory history;
+
+    EXPECT_CALL(server, GetWeather(::testing::_)).Times(4)
+            .WillRepeatedly(::testing::Invoke(&fake, &FakeWeatherServer::GetWeather));
+
+    EXPECT_EQ(0u, history.Load(server, "31.08.2018"));
+    EXPECT_EQ(0u, history.Load(server, "31.08.2018"));
+}
+
+TEST(WeatherHistory, ThrowsForUnknownDate)
+{
+    FakeWeatherServer server;
+    WeatherHistory history;
+
+    EXPECT_THROW(history.Load(server, "03.09.2018"), std::runtime_error);
+    EXPECT_EQ(0u, history.Size());
+}
+
+TEST(WeatherHistory, StatisticsOverSeveralDates)
+{
+    FakeWeatherServer server;
+    WeatherHistory history;
+    history.Load(server, "31.08.2018");
+    history.Load(server, "01.09.2018");
+    history.Load(server, "02.09.2018");
+
+    EXPECT_DOUBLE_EQ(305.0 / 12, history.GetAverageTemperature(0, 12));
+    EXPECT_DOUBLE_EQ(19, history.GetMinimumTemperature(0, 12));
+    EXPECT_DOUBLE_EQ(34, history.GetMaximumTemperature(0, 12));
+    EXPECT_DOUBLE_EQ(5.1, history.GetMaximumWindSpeed(0, 12));
+}
+
+// Path in the temporary directory, removed when the test ends
+class TemporaryFile
+{
+public:
+    explicit TemporaryFile(const std::string& name) : m_path(::testing::TempDir() + name)
+    {
+    }
+
+    ~TemporaryFile()
+    {
+        std::remove(m_path.c_str());
+    }
+
+    const std::string& GetPath() const
+    {
+        return m_path;
+    }
+
+private:
+    std::string m_path;
+};
+
+void WriteFile(const std::string& path, const std::string& data)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+TEST(MappedWeatherHistory, ReadsSavedHistory)
+{
+    FakeWeatherServer server;
+    WeatherHistory history;
+    history.Load(server, "02.09.2018");
+    history.Load(server, "31.08.2018");
+    history.Load(server, "01.09.2018");
+
+    TemporaryFile file("weather_history_saved.bin");
+    history.Save(file.GetPath());
+    const MappedWeatherHistory mapped(file.GetPath());
+
+    ASSERT_EQ(history.Size(), mapped.Size());
+    size_t firstRow = 0;
+    ASSERT_TRUE(mapped.FindDate("31.08.2018", firstRow));
+    EXPECT_EQ(4u, firstRow);
+    for (size_t row = 0; row < history.Size(); ++row)
+    {
+        EXPECT_TRUE(history.Get(row) == mapped.GetColumns().Get(row)) << row;
+    }
+    EXPECT_DOUBLE_EQ(history.GetAverageTemperature(0, 12), mapped.GetColumns().GetAverageTemperature(0, 12));
+    EXPECT_DOUBLE_EQ(history.GetAverageWindDirection(0, 12), mapped.GetColumns().GetAverageWindDirection(0, 12));
+    EXPECT_DOUBLE_EQ(5.1, mapped.GetColumns().GetMaximumWindSpeed(0, 12));
+}
+
+TEST(MappedWeatherHistory, FindsOnlySavedDates)
+{
+    FakeWeatherServer server;
+    WeatherHistory history;
+    history.Load(server, "01.09.2018");
+
+    TemporaryFile file("weather_history_dates.bin");
+    history.Save(file.GetPath());
+    const MappedWeatherHistory mapped(file.GetPath());
+
+    size_t firstRow = 0;
+    EXPECT_FALSE(mapped.FindDate("31.08.2018", firstRow));
+    EXPECT_FALSE(mapped.FindDate("garbage", firstRow));
+    EXPECT_TRUE(mapped.FindDate("01.09.2018", firstRow));
+}
+
+TEST(MappedWeatherHistory, EmptyHistory)
+{
+    TemporaryFile file("weather_history_empty.bin");
+    WeatherHistory().Save(file.GetPath());
+    EXPECT_EQ(0u, MappedWeatherHistory(file.GetPath()).Size());
+}
+
+TEST(MappedWeatherHistory, RejectsOtherFiles)
+{
+    TemporaryFile file("weather_history_other.bin");
+    EXPECT_THROW(MappedWeatherHistory(file.GetPath()), std::runtime_error);
+
+    WriteFile(file.GetPath(), "");
+    EXPECT_THROW(MappedWeatherHistory(file.GetPath()), std::runtime_error);
+
+    WriteFile(file.GetPath(), "20;181;5.1");
+    EXPECT_THROW(MappedWeatherHistory(file.GetPath()), std::runtime_error);
+}
+
+TEST(MappedWeatherHistory, RejectsTruncatedFile)
+{
+    FakeWeatherServer server;
+    WeatherHistory history;
+    history.Load(server, "01.09.2018");
+
+    TemporaryFile file("weather_history_truncated.bin");
+    history.Save(file.GetPath());
+    std::ifstream input(file.GetPath(), std::ios::binary);
+    const std::string data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    input.close();
+
+    WriteFile(file.GetPath(), data.substr(0, data.size() - 1));
+    EXPECT_THROW(MappedWeatherHistory(file.GetPath()), std::runtime_error);
+}
+
+TEST(WeatherClient, TakesArchivedDatesWithoutServer)
+{
+    FakeWeatherServer fake;
+    WeatherHistory history;
+    history.Load(fake, "31.08.2018");
+    TemporaryFile file("weather_history_archive.bin");
+    history.Save(file.GetPath());
+    const MappedWeatherHistory archive(file.GetPath());
+
+    MockWeatherServer server;
+    EXPECT_CALL(server, GetWeather(::testing::StartsWith("31.08.2018"))).Times(0);
+    EXPECT_CALL(server, GetWeather(::testing::StartsWith("01.09.2018"))).Times(4)
+            .WillRepeatedly(::testing::Invoke(&fake, &FakeWeatherServer::GetWeather));
+
+    WeatherClient client(&archive);
+    EXPECT_DOUBLE_EQ(25.5, client.GetAverageTemperature(server, "31.08.2018"));
+    EXPECT_NEAR(189.229, client.GetAverageWindDirection(server, "31.08.2018"), 0.001);
+    EXPECT_DOUBLE_EQ(19, client.GetMinimumTemperature(server, "01.09.2018"));
+}
+
+double GetReferenceCircularMean(const std::vector<unsigned short>& directions)
+{
+    const double pi = std::acos(-1.0);
+    double sinSum = 0;
+    double cosSum = 0;
+    for (unsigned short direction : directions)
+    {
+        sinSum += std::sin(direction * pi / 180);
+        cosSum += std::cos(direction * pi / 180);
+    }
+    const double mean = std::atan2(sinSum, cosSum) * 180 / pi;
+    return mean < 0 ? mean + 360 : mean;
+}
+
+TEST(GetCircularMean, SameDirection)
+{
+    const unsigned short directions[] = {181, 181, 181};
+    EXPECT_NEAR(181, GetCircularMean(directions, 3), 1e-9);
+}
+
+TEST(GetCircularMean, AcrossNorth)
+{
+    const unsigned short directions[] = {359, 1};
+    EXPECT_NEAR(0, GetCircularMean(directions, 2), 1e-9);
+}
+
+TEST(GetCircularMean, AcrossNorthWithWesterlyBias)
+{
+    const unsigned short directions[] = {350, 358, 10};
+    EXPECT_NEAR(359.33, GetCircularMean(directions, 3), 0.01);
+}
+
+TEST(GetCircularMean, OppositeDirectionsCancelOut)
+{
+    const unsigned short directions[] = {90, 270};
+    EXPECT_DOUBLE_EQ(0, GetCircularMean(directions, 2));
+}
+
+TEST(GetCircularMean, ReadingsOverload)
+{
+    Weather readings[2];
+    readings[0].windDirection = 355;
+    readings[1].windDirection = 15;
+    EXPECT_NEAR(5, GetCircularMean(readings, 2), 1e-9);
+}
+
+TEST(GetCircularMean, ReadingsSameAsDirections)
+{
+    std::vector<Weather> readings(100);
+    std::vector<unsigned short> directions;
+    for (size_t i = 0; i < readings.size(); ++i)
+    {
+        readings[i].windDirection = static_cast<unsigned short>(i * 37 % 360);
+        directions.push_back(readings[i].windDirection);
+    }
+    EXPECT_DOUBLE_EQ(GetCircularMean(directions.data(), directions.size()), GetCircularMean(readings.data(), readings.size()));
+}
+
+TEST(GetCircularMean, MatchesDoublePrecisionReference)
+{
+    std::vector<unsigned short> directions;
+    unsigned int seed = 42;
+    for (size_t size = 1; size < 1000; size += 37)
+    {
+        directions.clear();
+        for (size_t i = 0; i < size; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            directions.push_back(static_cast<unsigned short>(300 + (seed >> 16) % 120) % 360);
+        }
+        EXPECT_NEAR(GetReferenceCircularMean(directions), GetCircularMean(directions.data(), directions.size()), 1e-9);
+    }
+}
+
+TEST(WeatherClient, GetAverageTemperature)
+{
+    FakeWeatherServer server;
+    WeatherClient client;
+    EXPECT_DOUBLE_EQ(25.5, client.GetAverageTemperature(server, "31.08.2018"));
+}
+
+TEST(WeatherClient, GetMinimumTemperature)
+{
+    FakeWeatherServer server;
+    WeatherClient client;
+    EXPECT_DOUBLE_EQ(19, client.GetMinimumTemperature(server, "01.09.2018"));
+}
+
+TEST(WeatherClient, GetMaximumTemperature)
+{
+    FakeWeatherServer server;
+    WeatherClient client;
+    EXPECT_DOUBLE_EQ(34, client.GetMaximumTemperature(server, "02.09.2018"));
+}
+
+TEST(WeatherClient, GetAverageWindDirection)
+{
+    FakeWeatherServer server;
+    WeatherClient client;
+    EXPECT_NEAR(189.229, client.GetAverageWindDirection(server, "31.08.2018"), 0.001);
+}
+
+TEST(WeatherClient, GetMaximumWindSpeed)
+{
+    FakeWeatherServer server;
+    WeatherClient client;
+    EXPECT_DOUBLE_EQ(4.2, client.GetMaximumWindSpeed(server, "01.09.2018"));
+}
+
+// Holds every request until released, counting calls to the backend per request
+class GatedWeatherServer : public IWeatherServer
+{
+public:
+    std::string GetWeather(const std::string& request) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_calls[request];
+        }
+        m_gate.wait();
+        if (request == "fail")
+        {
+            throw std::runtime_error("Server is down");
+        }
+        return m_fake.GetWeather(request);
+    }
+
+    void Release()
+    {
+        m_release.set_value();
+    }
+
+    size_t GetCalls(const std::string& request)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_calls[request];
+    }
+
+private:
+    FakeWeatherServer m_fake;
+    std::promise<void> m_release;
+    std::shared_future<void> m_gate = m_release.get_future().share();
+    std::mutex m_mutex;
+    std::map<std::string, size_t> m_calls;
+};
+
+TEST(SingleFlightWeatherServer, PassesResponseThrough)
+{
+    FakeWeatherServer fake;
+    SingleFlightWeatherServer server(fake);
+    EXPECT_EQ("20;181;5.1", server.GetWeather("31.08.2018;03:00"));
+    EXPECT_EQ("", server.GetWeather("31.08.2018;04:00"));
+}
+
+TEST(SingleFlightWeatherServer, SequentialRequestsCallServerEachTime)
+{
+    FakeWeatherServer fake;
+    MockWeatherServer backend;
+    SingleFlightWeatherServer server(backend);
+
+    EXPECT_CALL(backend, GetWeather("31.08.2018;03:00")).Times(2)
+            .WillRepeatedly(::testing::Invoke(&fake, &FakeWeatherServer::GetWeather));
+
+    server.GetWeather("31.08.2018;03:00");
+    server.GetWeather("31.08.2018;03:00");
+}
+
+TEST(SingleFlightWeatherServer, ConcurrentIdenticalRequestsShareOneCall)
+{
+    const size_t threadsPerRequest = 16;
+    const char* const requests[] = {"31.08.2018;03:00", "02.09.2018;21:00"};
+
+    GatedWeatherServer backend;
+    SingleFlightWeatherServer server(backend);
+
+    std::vector<std::string> responses(threadsPerRequest * 2);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < responses.size(); ++i)
+    {
+        threads.emplace_back([&, i]()
+        {
+            responses[i] = server.GetWeather(requests[i % 2]);
+        });
+    }
+
+    // Every thread either called the backend or waits for a call in flight
+    while (backend.GetCalls(requests[0]) + backend.GetCalls(requests[1]) + server.GetWaiters() < responses.size())
+    {
+        std::this_thread::yield();
+    }
+    backend.Release();
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(1u, backend.GetCalls(requests[0]));
+    EXPECT_EQ(1u, backend.GetCalls(requests[1]));
+    for (size_t i = 0; i < responses.size(); ++i)
+    {
+        EXPECT_EQ(i % 2 ? "27;299;4.0" : "20;181;5.1", responses[i]);
+    }
+}
+
+TEST(SingleFlightWeatherServer, FailureIsSharedWithWaiters)
+{
+    GatedWeatherServer backend;
+    SingleFlightWeatherServer server(backend);
+
+    std::atomic<size_t> failures(0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        threads.emplace_back([&]()
+        {
+            try
+            {
+                server.GetWeather("fail");
+            }
+            catch (const std::runtime_error&)
+            {
+                ++failures;
+            }
+        });
+    }
+
+    while (backend.GetCalls("fail") + server.GetWaiters() < threads.size())
+    {
+        std::this_thread::yield();
+    }
+    backend.Release();
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(1u, backend.GetCalls("fail"));
+    EXPECT_EQ(4u, failures);
+}
+
+TEST(UnreliableWeatherServer, ReliableByDefault)
+{
+    FakeWeatherServer fake;
+    UnreliableWeatherServer server(fake, ServerConditions());
+    for (size_t i = 0; i < 100; ++i)
+    {
+        ASSERT_EQ("20;181;5.1", server.GetWeather("31.08.2018;03:00"));
+    }
+}
+
+TEST(UnreliableWeatherServer, AddsLatency)
+{
+    FakeWeatherServer fake;
+    ServerConditions conditions;
+    conditions.latency = std::chrono::milliseconds(20);
+    conditions.jitter = std::chrono::milliseconds(5);
+    UnreliableWeatherServer server(fake, conditions);
+
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ("20;181;5.1", server.GetWeather("31.08.2018;03:00"));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, conditions.latency);
+}
+
+TEST(UnreliableWeatherServer, AlwaysEmpty)
+{
+    FakeWeatherServer fake;
+    ServerConditions conditions;
+    conditions.emptyResponseRate = 1;
+    UnreliableWeatherServer server(fake, conditions);
+    EXPECT_EQ("", server.GetWeather("31.08.2018;03:00"));
+}
+
+TEST(UnreliableWeatherServer, EmptyResponseRate)
+{
+    FakeWeatherServer fake;
+    ServerConditions conditions;
+    conditions.emptyResponseRate = 0.25;
+    UnreliableWeatherServer server(fake, conditions, 7);
+
+    size_t empty = 0;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        empty += server.GetWeather("31.08.2018;03:00").empty();
+    }
+    EXPECT_GT(empty, 200u);
+    EXPECT_LT(empty, 300u);
+}
+
+TEST(UnreliableWeatherServer, SameSeedSameResponses)
+{
+    FakeWeatherServer fake;
+    ServerConditions conditions;
+    conditions.emptyResponseRate = 0.5;
+    UnreliableWeatherServer first(fake, conditions, 3);
+    UnreliableWeatherServer second(fake, conditions, 3);
+
+    for (size_t i = 0; i < 100; ++i)
+    {
+        ASSERT_EQ(first.GetWeather("01.09.2018;15:00"), second.GetWeather("01.09.2018;15:00"));
+    }
+}
+
+TEST(UnreliableWeatherServer, ClientFailsOnEmptyResponse)
+{
+    FakeWeatherServer fake;
+    ServerConditions conditions;
+    conditions.emptyResponseRate = 1;
+    UnreliableWeatherServer server(fake, conditions);
+    WeatherClient client;
+
+    EXPECT_THROW(client.GetAverageTemperature(server, "31.08.2018"), std::runtime_error);
+}
+
+TEST(UnreliableWeatherServer, ConcurrentClientsThroughSingleFlight)
+{
+    FakeWeatherServer fake;
+    ServerConditions conditions;
+    conditions.latency = std::chrono::milliseconds(1);
+    conditions.jitter = std::chrono::milliseconds(2);
+    UnreliableWeatherServer slow(fake, conditions);
+    SingleFlightWeatherServer server(slow);
+
+    std::vector<double> averages(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < averages.size(); ++i)
+    {
+        threads.emplace_back([&, i]()
+        {
+            WeatherClient client;
+            averages[i] = client.GetAverageTemperature(server, "31.08.2018");
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (double average : averages)
+    {
+        EXPECT_DOUBLE_EQ(25.5, average);
+    }
+}
+
+TEST(SocketWeatherServer, ReturnsRecordedResponse)
+{
+    FakeWeatherServer fake;
+    LoopbackWeatherServer loopback(fake);
+    SocketWeatherServer server(loopback.GetPort());
+
+    EXPECT_EQ("20;181;5.1", server.GetWeather("31.08.2018;03:00"));
+    EXPECT_EQ("27;299;4.0", server.GetWeather("02.09.2018;21:00"));
+}
+
+TEST(SocketWeatherServer, ReturnsEmptyStringForInvalidRequest)
+{
+    FakeWeatherServer fake;
+    LoopbackWeatherServer loopback(fake);
+    SocketWeatherServer server(loopback.GetPort());
+
+    EXPECT_EQ("", server.GetWeather("31.08.2018;04:00"));
+    EXPECT_EQ("", server.GetWeather(""));
+    EXPECT_EQ("", server.GetWeather("31.08.2018;03:00\n31.08.2018;09:00"));
+    EXPECT_EQ("20;181;5.1", server.GetWeather("31.08.2018;03:00"));
+}
+
+TEST(SocketWeatherServer, ThrowsWithoutServer)
+{
+    FakeWeatherServer fake;
+    LoopbackWeatherServer loopback(fake);
+    SocketWeatherServer server(loopback.GetPort());
+    loopback.Stop();
+
+    EXPECT_THROW(server.GetWeather("31.08.2018;03:00"), std::runtime_error);
+}
+
+TEST(SocketWeatherServer, ThrowsWhenServerFails)
+{
+    MockWeatherServer backend;
+    EXPECT_CALL(backend, GetWeather(::testing::_)).WillRepeatedly(::testing::Throw(std::runtime_error("Server is down")));
+    LoopbackWeatherServer loopback(backend);
+    SocketWeatherServer server(loopback.GetPort());
+
+    EXPECT_THROW(server.GetWeather("31.08.2018;03:00"), std::runtime_error);
+}
+
+TEST(SocketWeatherServer, ReconnectsToRestartedServer)
+{
+    FakeWeatherServer fake;
+    std::unique_ptr<LoopbackWeatherServer> loopback(new LoopbackWeatherServer(fake));
+    const unsigned short port = loopback->GetPort();
+    SocketWeatherServer server(port);
+    EXPECT_EQ("20;181;5.1", server.GetWeather("31.08.2018;03:00"));
+
+    loopback.reset();
+    loopback.reset(new LoopbackWeatherServer(fake, port));
+    EXPECT_EQ("20;181;5.1", server.GetWeather("31.08.2018;03:00"));
+}
+
+TEST(SocketWeatherServer, FaultInjectionOverSocket)
+{
+    FakeWeatherServer fake;
+    ServerConditions conditions;
+    conditions.latency = std::chrono::milliseconds(20);
+    conditions.emptyResponseRate = 1;
+    UnreliableWeatherServer unreliable(fake, conditions);
+    LoopbackWeatherServer loopback(unreliable);
+    SocketWeatherServer server(loopback.GetPort());
+
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ("", server.GetWeather("31.08.2018;03:00"));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, conditions.latency);
+}
+
+TEST(SocketWeatherServer, ConcurrentClientsEndToEnd)
+{
+    FakeWeatherServer fake;
+    ServerConditions conditions;
+    conditions.latency = std::chrono::milliseconds(1);
+    conditions.jitter = std::chrono::milliseconds(2);
+    UnreliableWeatherServer slow(fake, conditions);
+    LoopbackWeatherServer loopback(slow);
+    SocketWeatherServer socketServer(loopback.GetPort());
+    SingleFlightWeatherServer server(socketServer);
+
+    const char* const dates[] = {"31.08.2018", "01.09.2018", "02.09.2018"};
+    const double expected[] = {25.5, 24, 26.75};
+    std::vector<double> averages(12);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < averages.size(); ++i)
+    {
+        threads.emplace_back([&, i]()
+        {
+            WeatherClient client;
+            averages[i] = client.GetAverageTemperature(server, dates[i % 3]);
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (size_t i = 0; i < averages.size(); ++i)
+    {
+        EXPECT_DOUBLE_EQ(expected[i % 3], averages[i]);
+    }
+}
@@ -0,0 +1,506 @@
+#ifndef WEATHER_SERVER_H
+#define WEATHER_SERVER_H
+
+// Weather server side of the weather client homework, shared by its tests and the weather_server process:
+// the server interface, the fake server with recorded responses, fault injection and a TCP transport.
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+class IWeatherServer
+{
+public:
+    virtual ~IWeatherServer() { }
+    // Returns raw response with weather for the given day and time in request
+    virtual std::string GetWeather(const std::string& request) = 0;
+};
+
+class FakeWeatherServer : public IWeatherServer
+{
+public:
+    std::string GetWeather(const std::string& request) override
+    {
+        static const std::map<std::string, std::string> s_responses = {
+            {"31.08.2018;03:00", "20;181;5.1"},
+            {"31.08.2018;09:00", "23;204;4.9"},
+            {"31.08.2018;15:00", "33;193;4.3"},
+            {"31.08.2018;21:00", "26;179;4.5"},
+
+            {"01.09.2018;03:00", "19;176;4.2"},
+            {"01.09.2018;09:00", "22;131;4.1"},
+            {"01.09.2018;15:00", "31;109;4.0"},
+            {"01.09.2018;21:00", "24;127;4.1"},
+
+            {"02.09.2018;03:00", "21;158;3.8"},
+            {"02.09.2018;09:00", "25;201;3.5"},
+            {"02.09.2018;15:00", "34;258;3.7"},
+            {"02.09.2018;21:00", "27;299;4.0"}
+        };
+
+        auto response = s_responses.find(request);
+        return response == s_responses.end() ? std::string() : response->second;
+    }
+};
+
+struct ServerConditions
+{
+    std::chrono::microseconds latency = std::chrono::microseconds(0);
+    // Extra delay, uniformly distributed in [0, jitter]
+    std::chrono::microseconds jitter = std::chrono::microseconds(0);
+    // Share of requests answered with empty string as if they were invalid, from 0 to 1
+    double emptyResponseRate = 0;
+};
+
+// Fault injection for load testing: answers like the wrapped server,
+// but slowly and sometimes with empty responses. Random choices are reproducible for the same seed.
+class UnreliableWeatherServer : public IWeatherServer
+{
+public:
+    UnreliableWeatherServer(IWeatherServer& server, const ServerConditions& conditions, unsigned int seed = 0)
+        : m_server(server)
+        , m_conditions(conditions)
+        , m_random(seed)
+    {
+    }
+
+    std::string GetWeather(const std::string& request) override
+    {
+        std::chrono::microseconds delay = m_conditions.latency;
+        bool empty = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::uniform_int_distribution<long long> jitter(0, m_conditions.jitter.count());
+            std::bernoulli_distribution emptyResponse(m_conditions.emptyResponseRate);
+            delay += std::chrono::microseconds(jitter(m_random));
+            empty = emptyResponse(m_random);
+        }
+
+        if (delay.count() > 0)
+        {
+            std::this_thread::sleep_for(delay);
+        }
+        return empty ? std::string() : m_server.GetWeather(request);
+    }
+
+private:
+    IWeatherServer& m_server;
+    const ServerConditions m_conditions;
+    std::mutex m_mutex;
+    std::mt19937 m_random;
+};
+
+#if defined(_WIN32)
+typedef SOCKET SocketHandle;
+const SocketHandle s_invalidSocket = INVALID_SOCKET;
+const int s_shutdownBoth = SD_BOTH;
+const int s_sendFlags = 0;
+
+// Winsock has to be started once per process
+inline void InitSockets()
+{
+    struct SocketsLibrary
+    {
+        SocketsLibrary()
+        {
+            WSADATA data;
+            WSAStartup(MAKEWORD(2, 2), &data);
+        }
+        ~SocketsLibrary()
+        {
+            WSACleanup();
+        }
+    };
+    static SocketsLibrary s_library;
+}
+
+inline void CloseSocket(SocketHandle socket)
+{
+    closesocket(socket);
+}
+#else
+typedef int SocketHandle;
+const SocketHandle s_invalidSocket = -1;
+const int s_shutdownBoth = SHUT_RDWR;
+#if defined(MSG_NOSIGNAL)
+const int s_sendFlags = MSG_NOSIGNAL;
+#else
+const int s_sendFlags = 0;
+#endif
+
+inline void InitSockets()
+{
+}
+
+inline void CloseSocket(SocketHandle socket)
+{
+    close(socket);
+}
+#endif
+
+// Requests and responses are single short lines, anything longer is not the weather protocol
+const size_t s_maxWeatherLineLength = 1024;
+
+// Small messages go out at once, and a peer gone away is an error rather than a signal
+inline void TuneSocket(SocketHandle socket)
+{
+    int enable = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enable), sizeof(enable));
+#if defined(SO_NOSIGPIPE)
+    setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+#endif
+}
+
+inline bool SendAll(SocketHandle socket, const std::string& data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        const auto result = send(socket, data.data() + sent, static_cast<int>(data.size() - sent), s_sendFlags);
+        if (result <= 0)
+        {
+            return false;
+        }
+        sent += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+// Reads '\n' terminated lines from a connected socket
+class LineReader
+{
+public:
+    explicit LineReader(SocketHandle socket) : m_socket(socket)
+    {
+    }
+
+    // Returns false when the connection is closed or broken before a whole line, or the line is too long
+    bool ReadLine(std::string& line)
+    {
+        size_t end = m_buffer.find('\n');
+        while (end == std::string::npos)
+        {
+            char chunk[512];
+            const auto received = recv(m_socket, chunk, static_cast<int>(sizeof(chunk)), 0);
+            if (received <= 0 || m_buffer.size() > s_maxWeatherLineLength)
+            {
+                return false;
+            }
+            m_buffer.append(chunk, static_cast<size_t>(received));
+            end = m_buffer.find('\n');
+        }
+
+        line.assign(m_buffer, 0, end);
+        m_buffer.erase(0, end + 1);
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        return true;
+    }
+
+private:
+    SocketHandle m_socket;
+    std::string m_buffer;
+};
+
+inline sockaddr_in GetLoopbackAddress(unsigned short port)
+{
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    return address;
+}
+
+// Serves the wrapped server over TCP on 127.0.0.1: every "<request>\n" is answered with "<response>\n",
+// a connection may carry any number of requests. Every connection is served by its own thread,
+// so a slow response holds up only its own connection.
+class LoopbackWeatherServer
+{
+public:
+    // Port 0 takes any free port, see GetPort
+    explicit LoopbackWeatherServer(IWeatherServer& server, unsigned short port = 0) : m_server(server)
+    {
+        InitSockets();
+        m_listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (m_listener == s_invalidSocket)
+        {
+            throw std::runtime_error("Can not create weather server socket");
+        }
+#if !defined(_WIN32)
+        int enable = 1;
+        setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+#endif
+
+        sockaddr_in address = GetLoopbackAddress(port);
+        socklen_t addressSize = sizeof(address);
+        if (bind(m_listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(m_listener, SOMAXCONN) != 0 ||
+            getsockname(m_listener, reinterpret_cast<sockaddr*>(&address), &addressSize) != 0)
+        {
+            CloseSocket(m_listener);
+            throw std::runtime_error("Can not listen on port " + std::to_string(port));
+        }
+        m_port = ntohs(address.sin_port);
+        m_acceptThread = std::thread(&LoopbackWeatherServer::Accept, this);
+    }
+
+    ~LoopbackWeatherServer()
+    {
+        Stop();
+    }
+
+    LoopbackWeatherServer(const LoopbackWeatherServer&) = delete;
+    LoopbackWeatherServer& operator=(const LoopbackWeatherServer&) = delete;
+
+    unsigned short GetPort() const
+    {
+        return m_port;
+    }
+
+    // Stops accepting, drops all connections and waits for their threads
+    void Stop()
+    {
+        if (m_stopped.exchange(true))
+        {
+            return;
+        }
+
+        // Wakes the blocked accept up, it sees m_stopped and returns
+        const SocketHandle wakeUp = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        const sockaddr_in address = GetLoopbackAddress(m_port);
+        connect(wakeUp, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+        shutdown(m_listener, s_shutdownBoth);
+        m_acceptThread.join();
+        CloseSocket(wakeUp);
+        CloseSocket(m_listener);
+
+        for (const std::unique_ptr<ServedConnection>& connection : m_connections)
+        {
+            shutdown(connection->socket, s_shutdownBoth);
+        }
+        for (const std::unique_ptr<ServedConnection>& connection : m_connections)
+        {
+            connection->thread.join();
+            CloseSocket(connection->socket);
+        }
+        m_connections.clear();
+    }
+
+private:
+    struct ServedConnection
+    {
+        SocketHandle socket = s_invalidSocket;
+        std::thread thread;
+        std::atomic<bool> finished{false};
+    };
+
+    void Accept()
+    {
+        while (true)
+        {
+            const SocketHandle accepted = accept(m_listener, nullptr, nullptr);
+            if (m_stopped)
+            {
+                if (accepted != s_invalidSocket)
+                {
+                    CloseSocket(accepted);
+                }
+                return;
+            }
+            if (accepted == s_invalidSocket)
+            {
+                // Out of descriptors or the like, gives the served connections time to finish
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            ReapFinished();
+            TuneSocket(accepted);
+            std::unique_ptr<ServedConnection> connection(new ServedConnection);
+            connection->socket = accepted;
+            connection->thread = std::thread(&LoopbackWeatherServer::Serve, this, connection.get());
+            m_connections.push_back(std::move(connection));
+        }
+    }
+
+    // Clients come and go during long load tests, so closed connections are not kept until Stop
+    void ReapFinished()
+    {
+        for (size_t i = 0; i < m_connections.size();)
+        {
+            if (m_connections[i]->finished)
+            {
+                m_connections[i]->thread.join();
+                CloseSocket(m_connections[i]->socket);
+                m_connections[i] = std::move(m_connections.back());
+                m_connections.pop_back();
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+
+    void Serve(ServedConnection* connection)
+    {
+        LineReader reader(connection->socket);
+        std::string request;
+        try
+        {
+            while (reader.ReadLine(request))
+            {
+                if (!SendAll(connection->socket, m_server.GetWeather(request) + "\n"))
+                {
+                    break;
+                }
+            }
+        }
+        catch (...)
+        {
+            // The client sees the dropped connection as a failed request
+        }
+        shutdown(connection->socket, s_shutdownBoth);
+        connection->finished = true;
+    }
+
+private:
+    IWeatherServer& m_server;
+    SocketHandle m_listener = s_invalidSocket;
+    unsigned short m_port = 0;
+    std::atomic<bool> m_stopped{false};
+    std::thread m_acceptThread;
+    // Touched only by the accept thread until it is joined
+    std::vector<std::unique_ptr<ServedConnection>> m_connections;
+};
+
+// Asks LoopbackWeatherServer or the weather_server process over TCP on 127.0.0.1.
+// Connections are kept for reuse, concurrent requests go through separate connections.
+// Throws std::runtime_error when the server can not be reached.
+class SocketWeatherServer : public IWeatherServer
+{
+public:
+    explicit SocketWeatherServer(unsigned short port) : m_port(port)
+    {
+        InitSockets();
+    }
+
+    ~SocketWeatherServer()
+    {
+        for (const std::unique_ptr<Connection>& connection : m_idle)
+        {
+            CloseSocket(connection->socket);
+        }
+    }
+
+    SocketWeatherServer(const SocketWeatherServer&) = delete;
+    SocketWeatherServer& operator=(const SocketWeatherServer&) = delete;
+
+    std::string GetWeather(const std::string& request) override
+    {
+        // A line break would split the request in two, such request can not be valid anyway
+        if (request.find_first_of("\r\n") != std::string::npos)
+        {
+            return std::string();
+        }
+
+        std::unique_ptr<Connection> connection = TakeIdle();
+        std::string response;
+        // A kept connection may have been closed by the server meanwhile, so it gets one retry on a new one
+        if (connection == nullptr || !Ask(*connection, request, response))
+        {
+            if (connection != nullptr)
+            {
+                CloseSocket(connection->socket);
+            }
+            connection = Connect();
+            if (!Ask(*connection, request, response))
+            {
+                CloseSocket(connection->socket);
+                throw std::runtime_error("Lost connection to weather server on port " + std::to_string(m_port));
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idle.push_back(std::move(connection));
+        return response;
+    }
+
+private:
+    struct Connection
+    {
+        explicit Connection(SocketHandle connected) : socket(connected), reader(connected)
+        {
+        }
+
+        SocketHandle socket;
+        LineReader reader;
+    };
+
+    std::unique_ptr<Connection> TakeIdle()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_idle.empty())
+        {
+            return nullptr;
+        }
+        std::unique_ptr<Connection> connection = std::move(m_idle.back());
+        m_idle.pop_back();
+        return connection;
+    }
+
+    std::unique_ptr<Connection> Connect()
+    {
+        const SocketHandle connected = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        const sockaddr_in address = GetLoopbackAddress(m_port);
+        if (connected == s_invalidSocket ||
+            connect(connected, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            if (connected != s_invalidSocket)
+            {
+                CloseSocket(connected);
+            }
+            throw std::runtime_error("Can not connect to weather server on port " + std::to_string(m_port));
+        }
+        TuneSocket(connected);
+        return std::unique_ptr<Connection>(new Connection(connected));
+    }
+
+    static bool Ask(Connection& connection, const std::string& request, std::string& response)
+    {
+        return SendAll(connection.socket, request + "\n") && connection.reader.ReadLine(response);
+    }
+
+private:
+    const unsigned short m_port;
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Connection>> m_idle;
+};
+
+#endif // WEATHER_SERVER_H
@@ -0,0 +1,88 @@
+// Local stand-in for the real weather server, so that the weather client can be load tested end to end.
+// Serves the recorded responses of FakeWeatherServer over TCP on 127.0.0.1, one request per line,
+// with latency, jitter and empty responses injected by UnreliableWeatherServer. Runs until it is killed.
+//
+// Usage: weather_server [--port=N] [--latency-us=N] [--jitter-us=N] [--empty-rate=X] [--seed=N]
+
+#include "weather_server.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    // Takes the value of "--name=value" argument, returns false for other arguments
+    bool GetOption(const char* argument, const char* name, const char*& value)
+    {
+        const size_t nameLength = std::strlen(name);
+        if (std::strncmp(argument, name, nameLength) != 0 || argument[nameLength] != '=')
+        {
+            return false;
+        }
+        value = argument + nameLength + 1;
+        return true;
+    }
+
+    bool ParseNumber(const char* text, unsigned long max, unsigned long& number)
+    {
+        char* end = nullptr;
+        number = std::strtoul(text, &end, 10);
+        return end != text && *end == '\0' && *text != '-' && number <= max;
+    }
+
+    bool ParseRate(const char* text, double& rate)
+    {
+        char* end = nullptr;
+        rate = std::strtod(text, &end);
+        return end != text && *end == '\0' && rate >= 0 && rate <= 1;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned long port = 0;
+    unsigned long latency = 0;
+    unsigned long jitter = 0;
+    unsigned long seed = 0;
+    double emptyRate = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* value = nullptr;
+        const bool valid =
+            GetOption(argv[i], "--port", value) ? ParseNumber(value, 65535, port) :
+            GetOption(argv[i], "--latency-us", value) ? ParseNumber(value, 60000000, latency) :
+            GetOption(argv[i], "--jitter-us", value) ? ParseNumber(value, 60000000, jitter) :
+            GetOption(argv[i], "--seed", value) ? ParseNumber(value, 0xFFFFFFFF, seed) :
+            GetOption(argv[i], "--empty-rate", value) ? ParseRate(value, emptyRate) : false;
+        if (!valid)
+        {
+            std::cerr << "Invalid argument " << argv[i] << "\n"
+                      << "Usage: weather_server [--port=N] [--latency-us=N] [--jitter-us=N] [--empty-rate=X] [--seed=N]\n";
+            return 1;
+        }
+    }
+
+    ServerConditions conditions;
+    conditions.latency = std::chrono::microseconds(latency);
+    conditions.jitter = std::chrono::microseconds(jitter);
+    conditions.emptyResponseRate = emptyRate;
+
+    try
+    {
+        FakeWeatherServer recorded;
+        UnreliableWeatherServer unreliable(recorded, conditions, static_cast<unsigned int>(seed));
+        LoopbackWeatherServer server(unreliable, static_cast<unsigned short>(port));
+        std::cout << "Listening on 127.0.0.1:" << server.GetPort() << std::endl;
+        while (true)
+        {
+            std::this_thread::sleep_for(std::chrono::hours(1));
+        }
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,14 @@
+TEMPLATE = app
+CONFIG += console c++11 thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ..
+
+HEADERS += \
+    ../weather_server.h
+
+SOURCES += \
+    main.cpp
+
+win32: LIBS += -lws2_32
@@ -16,7 +16,30 @@ ignoring any possible match beginning after pos
 */
 
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <iostream>
+#include <istream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WRAP_STRING_SSE2
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 // empty string
 // string shorter than wrap number
@@ -30,28 +53,649 @@ ignoring any possible match beginning after pos
 
 using WrappedStrings = std::vector<std::string>;
 
+const char* FindLastSpaceScalar(const char* begin, const char* end)
+{
+    while (end != begin)
+    {
+        if (*--end == ' ')
+        {
+            return end;
+        }
+    }
+    return nullptr;
+}
+
+inline int GetHighestBit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanReverse(&index, mask);
+    return static_cast<int>(index);
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+// Returns the last space in [begin, end) or nullptr, compares 32 or 16 bytes at once where SIMD is available
+const char* FindLastSpace(const char* begin, const char* end)
+{
+#if defined(__AVX2__)
+    const __m256i spaces256 = _mm256_set1_epi8(' ');
+    while (end - begin >= 32)
+    {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(end - 32));
+        const unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, spaces256)));
+        if (mask != 0)
+        {
+            return end - 32 + GetHighestBit(mask);
+        }
+        end -= 32;
+    }
+#endif
+#if defined(WRAP_STRING_SSE2)
+    const __m128i spaces = _mm_set1_epi8(' ');
+    while (end - begin >= 16)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(end - 16));
+        const unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, spaces)));
+        if (mask != 0)
+        {
+            return end - 16 + GetHighestBit(mask);
+        }
+        end -= 16;
+    }
+#endif
+    return FindLastSpaceScalar(begin, end);
+}
+
+// Calls sink(line, length) for every wrapped line in one pass over the text, lines point into the text.
+// A line breaks at the last space which fits into wrapLength, or at wrapLength if there is none.
+// Spaces at the line edges are dropped.
+template<typename LineSink>
+void WrapLines(const char* text, size_t size, size_t wrapLength, LineSink sink)
+{
+    if (wrapLength == 0)
+    {
+        return;
+    }
+
+    const char* cur = text;
+    const char* const end = cur + size;
+    while (true)
+    {
+        while (cur != end && *cur == ' ')
+        {
+            ++cur;
+        }
+        if (cur == end)
+        {
+            return;
+        }
+
+        const char* lineEnd = end;
+        const char* next = end;
+        if (static_cast<size_t>(end - cur) > wrapLength)
+        {
+            // The character right after the limit may be a space to break at as well
+            const char* space = FindLastSpace(cur + 1, cur + wrapLength + 1);
+            lineEnd = space != nullptr ? space : cur + wrapLength;
+            next = space != nullptr ? space + 1 : cur + wrapLength;
+        }
+
+        while (lineEnd[-1] == ' ')
+        {
+            --lineEnd;
+        }
+        sink(cur, static_cast<size_t>(lineEnd - cur));
+        cur = next;
+    }
+}
+
+template<typename LineSink>
+void WrapLines(const std::string& str, size_t wrapLength, LineSink sink)
+{
+    WrapLines(str.data(), str.size(), wrapLength, sink);
+}
+
+// Produces the same lines as WrapLines for the whole text, but reads it chunk by chunk
+// and keeps no more than wrapLength + 1 characters of it besides the chunk. Zero chunk size reads by one character.
+template<typename LineSink>
+void WrapStream(std::istream& input, size_t wrapLength, LineSink sink, size_t chunkSize = 4096)
+{
+    if (wrapLength == 0)
+    {
+        return;
+    }
+
+    std::vector<char> chunk(std::max<size_t>(chunkSize, 1));
+    std::string line;
+    line.reserve(wrapLength + 1);
+    while (input.read(chunk.data(), static_cast<std::streamsize>(chunk.size())) || input.gcount() > 0)
+    {
+        const size_t read = static_cast<size_t>(input.gcount());
+        for (size_t i = 0; i < read; ++i)
+        {
+            if (line.empty() && chunk[i] == ' ')
+            {
+                continue;
+            }
+            line.push_back(chunk[i]);
+            if (line.size() <= wrapLength)
+            {
+                continue;
+            }
+
+            const char* begin = line.data();
+            const char* space = FindLastSpace(begin + 1, begin + line.size());
+            const char* lineEnd = space != nullptr ? space : begin + wrapLength;
+            const char* next = space != nullptr ? space + 1 : begin + wrapLength;
+            while (lineEnd[-1] == ' ')
+            {
+                --lineEnd;
+            }
+            sink(begin, static_cast<size_t>(lineEnd - begin));
+
+            line.erase(0, static_cast<size_t>(next - begin));
+            line.erase(0, line.find_first_not_of(' '));
+        }
+    }
+
+    const size_t lineEnd = line.find_last_not_of(' ');
+    if (lineEnd != std::string::npos)
+    {
+        sink(line.data(), lineEnd + 1);
+    }
+}
+
 WrappedStrings WrapString(const std::string& str, size_t wrapLength)
 {
     WrappedStrings result;
-    for(size_t i = 0; i < str.length(); i += wrapLength)
+    WrapLines(str, wrapLength, [&result](const char* line, size_t length)
+    {
+        result.emplace_back(line, length);
+    });
+    return result;
+}
+
+struct CodePointRange
+{
+    uint32_t first;
+    uint32_t last;
+};
+
+// Combining marks and other code points taking no column of their own, sorted
+const CodePointRange s_zeroWidthRanges[] = {
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x0610, 0x061A}, {0x064B, 0x065F},
+    {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF},
+    {0x200B, 0x200F}, {0x20D0, 0x20FF}, {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F}, {0x1F3FB, 0x1F3FF},
+    {0xE0100, 0xE01EF}
+};
+
+// East Asian Wide and Fullwidth code points, sorted
+const CodePointRange s_wideRanges[] = {
+    {0x1100, 0x115F}, {0x2E80, 0x303E}, {0x3041, 0x33FF}, {0x3400, 0x4DBF}, {0x4E00, 0x9FFF},
+    {0xA000, 0xA4CF}, {0xA960, 0xA97F}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE10, 0xFE19},
+    {0xFE30, 0xFE6F}, {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x1F300, 0x1F3FA}, {0x1F400, 0x1F64F},
+    {0x1F900, 0x1F9FF}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD}
+};
+
+const uint32_t s_zeroWidthJoiner = 0x200D;
+const uint32_t s_replacementCharacter = 0xFFFD;
+
+template<size_t Size>
+bool IsInRanges(uint32_t codePoint, const CodePointRange (&ranges)[Size])
+{
+    const CodePointRange* range = std::upper_bound(ranges, ranges + Size, codePoint,
+                                                   [](uint32_t value, const CodePointRange& right)
+    {
+        return value < right.first;
+    });
+    return range != ranges && codePoint <= range[-1].last;
+}
+
+// Number of terminal columns the code point takes: 0, 1 or 2
+size_t GetDisplayWidth(uint32_t codePoint)
+{
+    if (codePoint < 0x300)
+    {
+        return 1;
+    }
+    if (IsInRanges(codePoint, s_zeroWidthRanges))
+    {
+        return 0;
+    }
+    return IsInRanges(codePoint, s_wideRanges) ? 2 : 1;
+}
+
+// Decodes one code point and moves cur past it, malformed sequences decode byte by byte as U+FFFD
+uint32_t DecodeUtf8(const char*& cur, const char* end)
+{
+    const unsigned char lead = static_cast<unsigned char>(*cur++);
+    if (lead < 0x80)
+    {
+        return lead;
+    }
+
+    size_t continuations = 0;
+    uint32_t codePoint = 0;
+    uint32_t minimum = 0;
+    if ((lead & 0xE0) == 0xC0)
+    {
+        continuations = 1;
+        codePoint = lead & 0x1F;
+        minimum = 0x80;
+    }
+    else if ((lead & 0xF0) == 0xE0)
+    {
+        continuations = 2;
+        codePoint = lead & 0x0F;
+        minimum = 0x800;
+    }
+    else if ((lead & 0xF8) == 0xF0)
+    {
+        continuations = 3;
+        codePoint = lead & 0x07;
+        minimum = 0x10000;
+    }
+    else
+    {
+        return s_replacementCharacter;
+    }
+
+    if (static_cast<size_t>(end - cur) < continuations)
+    {
+        return s_replacementCharacter;
+    }
+    for (size_t i = 0; i < continuations; ++i)
     {
-        std::string cur = str.substr(i, wrapLength);
-        if (cur.back() == ' ')
+        const unsigned char next = static_cast<unsigned char>(cur[i]);
+        if ((next & 0xC0) != 0x80)
         {
-            cur.pop_back();
+            return s_replacementCharacter;
         }
+        codePoint = (codePoint << 6) | (next & 0x3F);
+    }
+    if (codePoint < minimum || codePoint > 0x10FFFF)
+    {
+        return s_replacementCharacter;
+    }
+
+    cur += continuations;
+    return codePoint;
+}
+
+// Moves cur past one grapheme cluster: a code point with the zero width marks following it
+// and code points joined to it by ZWJ. Returns the columns the cluster takes.
+size_t SkipGraphemeCluster(const char*& cur, const char* end)
+{
+    if (static_cast<unsigned char>(*cur) < 0x80 &&
+        (cur + 1 == end || static_cast<unsigned char>(cur[1]) < 0x80))
+    {
+        ++cur;
+        return 1;
+    }
 
-        if(!cur.empty() && cur.front() == ' ')
+    const size_t width = GetDisplayWidth(DecodeUtf8(cur, end));
+    while (cur != end && static_cast<unsigned char>(*cur) >= 0x80)
+    {
+        const char* next = cur;
+        const uint32_t codePoint = DecodeUtf8(next, end);
+        if (codePoint == s_zeroWidthJoiner && next != end)
         {
-            cur = cur.substr(1);
+            DecodeUtf8(next, end);
         }
+        else if (GetDisplayWidth(codePoint) != 0)
+        {
+            break;
+        }
+        cur = next;
+    }
+    return width;
+}
 
-        if(!cur.empty())
+bool IsAscii(const char* text, size_t size)
+{
+    unsigned char bits = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        bits |= static_cast<unsigned char>(text[i]);
+    }
+    return bits < 0x80;
+}
+
+// Same rules as WrapLines for UTF-8 text, but lines are measured in terminal columns
+// and are broken only between grapheme clusters. A cluster wider than the limit gets a line of its own.
+template<typename LineSink>
+void WrapUtf8Lines(const char* text, size_t size, size_t columns, LineSink sink)
+{
+    if (IsAscii(text, size))
+    {
+        WrapLines(text, size, columns, sink);
+        return;
+    }
+    if (columns == 0)
+    {
+        return;
+    }
+
+    const char* cur = text;
+    const char* const end = cur + size;
+    while (true)
+    {
+        while (cur != end && *cur == ' ')
+        {
+            ++cur;
+        }
+        if (cur == end)
+        {
+            return;
+        }
+
+        // Find the first cluster which does not fit and the last space before it
+        const char* lastSpace = nullptr;
+        const char* overflow = cur;
+        size_t width = 0;
+        while (overflow != end)
+        {
+            const char* clusterEnd = overflow;
+            const size_t clusterWidth = SkipGraphemeCluster(clusterEnd, end);
+            if (width + clusterWidth > columns)
+            {
+                break;
+            }
+            if (*overflow == ' ')
+            {
+                lastSpace = overflow;
+            }
+            width += clusterWidth;
+            overflow = clusterEnd;
+        }
+
+        const char* lineEnd = end;
+        const char* next = end;
+        if (overflow != end)
+        {
+            const char* space = *overflow == ' ' ? overflow : lastSpace;
+            if (space != nullptr)
+            {
+                lineEnd = space;
+                next = space + 1;
+            }
+            else
+            {
+                if (overflow == cur)
+                {
+                    SkipGraphemeCluster(overflow, end);
+                }
+                lineEnd = overflow;
+                next = overflow;
+            }
+        }
+
+        while (lineEnd[-1] == ' ')
+        {
+            --lineEnd;
+        }
+        sink(cur, static_cast<size_t>(lineEnd - cur));
+        cur = next;
+    }
+}
+
+WrappedStrings WrapStringUtf8(const std::string& str, size_t columns)
+{
+    WrappedStrings result;
+    WrapUtf8Lines(str.data(), str.size(), columns, [&result](const char* line, size_t length)
+    {
+        result.emplace_back(line, length);
+    });
+    return result;
+}
+
+struct Word
+{
+    const char* begin;
+    size_t length;
+};
+
+// Splits text at spaces, words longer than wrapLength are cut into wrapLength pieces like WrapString does
+std::vector<Word> SplitWords(const std::string& str, size_t wrapLength)
+{
+    std::vector<Word> words;
+    const char* cur = str.data();
+    const char* const end = cur + str.size();
+    while (cur != end)
+    {
+        if (*cur == ' ')
+        {
+            ++cur;
+            continue;
+        }
+        const char* wordEnd = cur;
+        while (wordEnd != end && *wordEnd != ' ')
+        {
+            ++wordEnd;
+        }
+        for (; cur != wordEnd; cur += std::min(wrapLength, static_cast<size_t>(wordEnd - cur)))
+        {
+            words.push_back({cur, std::min(wrapLength, static_cast<size_t>(wordEnd - cur))});
+        }
+    }
+    return words;
+}
+
+// Wraps words joined by single spaces into lines not longer than wrapLength, minimizing
+// the sum of squares of free space at the end of every line but the last one.
+// The cost of a line satisfies the quadrangle inequality, so once a later line start beats an earlier one
+// it stays better for all further words. Candidates are kept in a queue with the ranges they win,
+// which makes the search O(n log n) instead of trying every line start for every word.
+WrappedStrings WrapStringBalanced(const std::string& str, size_t wrapLength)
+{
+    if (wrapLength == 0)
+    {
+        return WrappedStrings();
+    }
+
+    const std::vector<Word> words = SplitWords(str, wrapLength);
+    const size_t count = words.size();
+
+    // Line of words [first, last) takes offsets[last] - offsets[first] - 1 characters
+    std::vector<long long> offsets(count + 1, 0);
+    for (size_t i = 0; i < count; ++i)
+    {
+        offsets[i + 1] = offsets[i] + static_cast<long long>(words[i].length) + 1;
+    }
+
+    const long long width = static_cast<long long>(wrapLength);
+    const long long tooLong = std::numeric_limits<long long>::max() / 4;
+    std::vector<long long> costs(count + 1, 0);
+    auto getCost = [&](size_t first, size_t last)
+    {
+        const long long length = offsets[last] - offsets[first] - 1;
+        return length > width ? tooLong : costs[first] + (width - length) * (width - length);
+    };
+
+    struct Candidate
+    {
+        size_t first;
+        size_t winsFrom;
+    };
+    std::deque<Candidate> candidates;
+    candidates.push_back({0, 1});
+    std::vector<size_t> lineStarts(count + 1, 0);
+    for (size_t last = 1; last < count; ++last)
+    {
+        while (candidates.size() > 1 && candidates[1].winsFrom <= last)
+        {
+            candidates.pop_front();
+        }
+        lineStarts[last] = candidates.front().first;
+        costs[last] = getCost(lineStarts[last], last);
+
+        // Line starting at word last is a candidate for all further words
+        size_t winsFrom = last + 1;
+        while (!candidates.empty())
         {
-            result.push_back(cur);
+            const size_t from = std::max(candidates.back().winsFrom, last + 1);
+            if (getCost(last, from) > getCost(candidates.back().first, from))
+            {
+                size_t low = from + 1;
+                size_t high = count + 1;
+                while (low < high)
+                {
+                    const size_t middle = low + (high - low) / 2;
+                    if (getCost(last, middle) <= getCost(candidates.back().first, middle))
+                    {
+                        high = middle;
+                    }
+                    else
+                    {
+                        low = middle + 1;
+                    }
+                }
+                winsFrom = low;
+                break;
+            }
+            candidates.pop_back();
         }
+        if (winsFrom <= count)
+        {
+            candidates.push_back({last, winsFrom});
+        }
+    }
+
+    // The last line is free, it starts at the cheapest line start which fits
+    size_t lastLineStart = count;
+    for (size_t first = count; first-- > 0 && offsets[count] - offsets[first] - 1 <= width;)
+    {
+        if (lastLineStart == count || costs[first] < costs[lastLineStart])
+        {
+            lastLineStart = first;
+        }
+    }
+
+    WrappedStrings result;
+    for (size_t last = count; last > 0; last = lastLineStart, lastLineStart = lineStarts[last])
+    {
+        std::string line(words[lastLineStart].begin, words[lastLineStart].length);
+        for (size_t i = lastLineStart + 1; i < last; ++i)
+        {
+            line += ' ';
+            line.append(words[i].begin, words[i].length);
+        }
+        result.push_back(line);
+    }
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+// Calls task(index) for every index in [0, tasksCount) on threadsCount threads
+template<typename Task>
+void RunInParallel(size_t tasksCount, size_t threadsCount, Task task)
+{
+    const size_t tasksPerTake = 64;
+    std::atomic<size_t> nextTask(0);
+    auto worker = [&]()
+    {
+        for (size_t first = nextTask.fetch_add(tasksPerTake); first < tasksCount; first = nextTask.fetch_add(tasksPerTake))
+        {
+            for (size_t index = first; index < std::min(first + tasksPerTake, tasksCount); ++index)
+            {
+                task(index);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadsCount; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+// Part of a text that is not copied out of it
+struct TextSpan
+{
+    const char* begin;
+    size_t length;
+};
+
+// Paragraphs are separated by lines without words, leading and trailing ones are dropped
+std::vector<TextSpan> SplitParagraphs(const std::string& text)
+{
+    std::vector<TextSpan> paragraphs;
+    size_t paragraphBegin = std::string::npos;
+    size_t paragraphEnd = 0;
+    for (size_t begin = 0; begin < text.size();)
+    {
+        size_t end = text.find('\n', begin);
+        end = end == std::string::npos ? text.size() : end;
+        if (text.find_first_not_of(' ', begin) < end)
+        {
+            paragraphBegin = paragraphBegin == std::string::npos ? begin : paragraphBegin;
+            paragraphEnd = end;
+        }
+        else if (paragraphBegin != std::string::npos)
+        {
+            paragraphs.push_back({text.data() + paragraphBegin, paragraphEnd - paragraphBegin});
+            paragraphBegin = std::string::npos;
+        }
+        begin = end + 1;
+    }
+
+    if (paragraphBegin != std::string::npos)
+    {
+        paragraphs.push_back({text.data() + paragraphBegin, paragraphEnd - paragraphBegin});
+    }
+    return paragraphs;
+}
+
+// Reflows every paragraph of the text, so line breaks inside a paragraph are treated as spaces.
+// Paragraphs are processed in parallel, each wrapped line ends with a new line, paragraphs are separated by an empty line.
+std::string WrapDocument(const std::string& text, size_t wrapLength, size_t threadsCount)
+{
+    const std::vector<TextSpan> paragraphs = SplitParagraphs(text);
+
+    // Only hard wrapped paragraphs are copied, to replace their line breaks
+    std::vector<std::string> reflowed(paragraphs.size());
+    std::vector<std::vector<TextSpan>> lines(paragraphs.size());
+    std::vector<size_t> offsets(paragraphs.size() + 1, 0);
+    RunInParallel(paragraphs.size(), threadsCount, [&](size_t paragraph)
+    {
+        TextSpan source = paragraphs[paragraph];
+        if (std::find(source.begin, source.begin + source.length, '\n') != source.begin + source.length)
+        {
+            reflowed[paragraph].assign(source.begin, source.length);
+            std::replace(reflowed[paragraph].begin(), reflowed[paragraph].end(), '\n', ' ');
+            source = {reflowed[paragraph].data(), reflowed[paragraph].size()};
+        }
+
+        WrapLines(source.begin, source.length, wrapLength, [&](const char* line, size_t length)
+        {
+            lines[paragraph].push_back({line, length});
+            offsets[paragraph + 1] += length + 1;
+        });
+        offsets[paragraph + 1] += paragraph + 1 < paragraphs.size();
+    });
+
+    for (size_t paragraph = 0; paragraph < paragraphs.size(); ++paragraph)
+    {
+        offsets[paragraph + 1] += offsets[paragraph];
     }
 
+    std::string result(offsets.back(), '\n');
+    RunInParallel(paragraphs.size(), threadsCount, [&](size_t paragraph)
+    {
+        char* out = &result[0] + offsets[paragraph];
+        for (const TextSpan& line : lines[paragraph])
+        {
+            out = std::copy(line.begin, line.begin + line.length, out) + 1;
+        }
+    });
     return result;
 }
 
@@ -94,3 +738,553 @@ TEST(WrapString, StringWrappedBySeveralWhitespace)
     WrappedStrings expected = {"12", "34"};
     ASSERT_EQ(expected, WrapString("12  34", 3));
 }
+
+TEST(WrapString, OnlyWhitespaces)
+{
+    ASSERT_EQ(WrappedStrings(), WrapString("     ", 2));
+}
+
+TEST(WrapString, ZeroWrapLength)
+{
+    ASSERT_EQ(WrappedStrings(), WrapString("1 2", 0));
+}
+
+TEST(WrapString, BreaksAtLastSpaceUnderLimit)
+{
+    WrappedStrings expected = {"12 34", "56"};
+    ASSERT_EQ(expected, WrapString("12 34 56", 6));
+}
+
+TEST(WrapString, WordLongerThanWrapNumberAfterSpace)
+{
+    WrappedStrings expected = {"1", "2345", "6"};
+    ASSERT_EQ(expected, WrapString("1 23456", 4));
+}
+
+TEST(WrapString, Acceptance)
+{
+    WrappedStrings expected = {"When pos is specified, the",
+                               "search only includes sequences",
+                               "of characters that begin at or",
+                               "before position pos, ignoring",
+                               "any possible match beginning",
+                               "after pos."};
+    ASSERT_EQ(expected, WrapString("When pos is specified, the search only includes sequences of characters "
+                                   "that begin at or before position pos, ignoring any possible match beginning after pos.", 30));
+}
+
+TEST(WrapLines, LinesPointIntoSource)
+{
+    const std::string text = "12  34 5";
+    std::vector<size_t> offsets;
+    WrapLines(text, 3, [&](const char* line, size_t)
+    {
+        offsets.push_back(static_cast<size_t>(line - text.data()));
+    });
+
+    ASSERT_EQ(std::vector<size_t>({0, 4, 7}), offsets);
+}
+
+TEST(FindLastSpace, NoSpaces)
+{
+    const std::string text(100, 'a');
+    EXPECT_EQ(nullptr, FindLastSpace(text.data(), text.data() + text.size()));
+    EXPECT_EQ(nullptr, FindLastSpace(text.data(), text.data()));
+}
+
+TEST(FindLastSpace, FindsLastOfSeveral)
+{
+    const std::string text = "a b" + std::string(40, 'c') + " d" + std::string(40, 'e');
+    EXPECT_EQ(text.data() + 43, FindLastSpace(text.data(), text.data() + text.size()));
+    EXPECT_EQ(text.data() + 1, FindLastSpace(text.data(), text.data() + 43));
+}
+
+TEST(FindLastSpace, SameAsScalar)
+{
+    std::string text;
+    unsigned int seed = 1;
+    for (size_t i = 0; i < 300; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        text += (seed >> 16) % 23 == 0 ? ' ' : 'x';
+    }
+
+    for (size_t begin = 0; begin < 70; ++begin)
+    {
+        for (size_t end = begin; end <= text.size(); ++end)
+        {
+            ASSERT_EQ(FindLastSpaceScalar(text.data() + begin, text.data() + end),
+                      FindLastSpace(text.data() + begin, text.data() + end));
+        }
+    }
+}
+
+// Throughput benchmarks are disabled by default,
+// run them with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+
+// Repeats the function for half a second and returns megabytes of input processed per second
+template<typename Function>
+double GetMegabytesPerSecond(size_t bytesPerRun, Function function)
+{
+    const auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed(0);
+    size_t runs = 0;
+    while (elapsed.count() < 0.5)
+    {
+        function();
+        ++runs;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    return static_cast<double>(bytesPerRun) * runs / elapsed.count() / 1e6;
+}
+
+void ReportMegabytesPerSecond(const std::string& name, double megabytesPerSecond)
+{
+    std::cout << "[ MEASURED ] " << name << ": " << megabytesPerSecond << " MB/s" << std::endl;
+}
+
+// Words of random letters, spaceRate of 1000 characters are spaces
+std::string GenerateText(size_t size, unsigned int spaceRate, unsigned int seed)
+{
+    std::string text;
+    text.reserve(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        const unsigned int random = (seed >> 16) % 1000;
+        text += random < spaceRate ? ' ' : static_cast<char>('a' + random % 26);
+    }
+    return text;
+}
+
+TEST(WrapStringBenchmark, DISABLED_FindLastSpace)
+{
+    // Without spaces the whole range is searched
+    const std::string text(4096, 'x');
+    size_t found = 0;
+
+    ReportMegabytesPerSecond("FindLastSpace", GetMegabytesPerSecond(text.size(), [&]()
+    {
+        found += FindLastSpace(text.data(), text.data() + text.size()) != nullptr;
+    }));
+    ReportMegabytesPerSecond("FindLastSpaceScalar", GetMegabytesPerSecond(text.size(), [&]()
+    {
+        found += FindLastSpaceScalar(text.data(), text.data() + text.size()) != nullptr;
+    }));
+    EXPECT_EQ(0u, found);
+}
+
+TEST(WrapStringBenchmark, DISABLED_WrapLines)
+{
+    const size_t wrapLength = 80;
+    for (unsigned int spaceRate : {150u, 15u})
+    {
+        const std::string text = GenerateText(1 << 20, spaceRate, 7);
+        size_t lines = 0;
+        ReportMegabytesPerSecond("WrapLines, " + std::to_string(spaceRate) + " spaces per 1000 characters",
+                                 GetMegabytesPerSecond(text.size(), [&]()
+        {
+            WrapLines(text, wrapLength, [&lines](const char*, size_t)
+            {
+                ++lines;
+            });
+        }));
+        EXPECT_GT(lines, 0u);
+    }
+}
+
+WrappedStrings WrapStreamToStrings(const std::string& str, size_t wrapLength, size_t chunkSize)
+{
+    std::istringstream input(str);
+    WrappedStrings result;
+    WrapStream(input, wrapLength, [&result](const char* line, size_t length)
+    {
+        result.emplace_back(line, length);
+    }, chunkSize);
+    return result;
+}
+
+TEST(WrapStream, EmptyStream)
+{
+    ASSERT_EQ(WrappedStrings(), WrapStreamToStrings("", 5, 4));
+}
+
+TEST(WrapStream, WordCrossesChunks)
+{
+    WrappedStrings expected = {"12", "34"};
+    ASSERT_EQ(expected, WrapStreamToStrings("12  34", 3, 1));
+}
+
+TEST(WrapStream, ZeroChunkSize)
+{
+    ASSERT_EQ(WrappedStrings({"ab"}), WrapStreamToStrings("ab", 5, 0));
+}
+
+TEST(WrapStream, SameAsWrapString)
+{
+    const std::string text = "When pos is specified, the search only includes sequences of characters "
+                             "that begin at or before position pos,   ignoring any possible match beginning after pos.  ";
+    for (size_t wrapLength = 0; wrapLength < 40; ++wrapLength)
+    {
+        for (size_t chunkSize = 1; chunkSize < 20; ++chunkSize)
+        {
+            ASSERT_EQ(WrapString(text, wrapLength), WrapStreamToStrings(text, wrapLength, chunkSize));
+        }
+    }
+}
+
+TEST(WrapStream, LargeInput)
+{
+    std::string text;
+    unsigned int seed = 5;
+    for (size_t i = 0; i < 100000; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        text += (seed >> 16) % 7 == 0 ? ' ' : static_cast<char>('a' + (seed >> 16) % 26);
+    }
+
+    ASSERT_EQ(WrapString(text, 80), WrapStreamToStrings(text, 80, 4096));
+}
+
+TEST(GetDisplayWidth, Widths)
+{
+    EXPECT_EQ(1u, GetDisplayWidth('a'));
+    EXPECT_EQ(1u, GetDisplayWidth(0x0456));
+    EXPECT_EQ(0u, GetDisplayWidth(0x0301));
+    EXPECT_EQ(2u, GetDisplayWidth(0x4F60));
+    EXPECT_EQ(2u, GetDisplayWidth(0xAC00));
+    EXPECT_EQ(2u, GetDisplayWidth(0x1F600));
+    EXPECT_EQ(1u, GetDisplayWidth(0x10FFFF));
+}
+
+TEST(DecodeUtf8, DecodesAndSkips)
+{
+    const std::string text = "a\xD1\x96\xE4\xBD\xA0\xF0\x9F\x98\x80";
+    const char* cur = text.data();
+    const char* end = cur + text.size();
+    EXPECT_EQ(uint32_t('a'), DecodeUtf8(cur, end));
+    EXPECT_EQ(0x0456u, DecodeUtf8(cur, end));
+    EXPECT_EQ(0x4F60u, DecodeUtf8(cur, end));
+    EXPECT_EQ(0x1F600u, DecodeUtf8(cur, end));
+    EXPECT_EQ(end, cur);
+}
+
+TEST(DecodeUtf8, MalformedBytes)
+{
+    const std::string text = "\xFF\xD1\xE4\xBD";
+    const char* cur = text.data();
+    const char* end = cur + text.size();
+    EXPECT_EQ(s_replacementCharacter, DecodeUtf8(cur, end));
+    EXPECT_EQ(s_replacementCharacter, DecodeUtf8(cur, end));
+    EXPECT_EQ(s_replacementCharacter, DecodeUtf8(cur, end));
+    EXPECT_EQ(s_replacementCharacter, DecodeUtf8(cur, end));
+    EXPECT_EQ(end, cur);
+}
+
+TEST(WrapStringUtf8, AsciiSameAsWrapString)
+{
+    const std::string text = "When pos is specified, the search only includes sequences of characters";
+    for (size_t columns = 0; columns < 30; ++columns)
+    {
+        ASSERT_EQ(WrapString(text, columns), WrapStringUtf8(text, columns));
+    }
+}
+
+TEST(WrapStringUtf8, DoesNotSplitCodePoints)
+{
+    WrappedStrings expected = {"\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD1\x96\xD1\x82",
+                               "\xD1\x81\xD0\xB2\xD1\x96\xD1\x82"};
+    ASSERT_EQ(expected, WrapStringUtf8("\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD1\x96\xD1\x82 "
+                                       "\xD1\x81\xD0\xB2\xD1\x96\xD1\x82", 6));
+}
+
+TEST(WrapStringUtf8, HardBreakOfCyrillicWord)
+{
+    WrappedStrings expected = {"\xD0\xBF\xD1\x80\xD0\xB8", "\xD0\xB2\xD1\x96\xD1\x82"};
+    ASSERT_EQ(expected, WrapStringUtf8("\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD1\x96\xD1\x82", 3));
+}
+
+TEST(WrapStringUtf8, WideCharactersTakeTwoColumns)
+{
+    const std::string text = "\xE4\xBD\xA0\xE5\xA5\xBD\xE4\xB8\x96\xE7\x95\x8C";
+    WrappedStrings byTwo = {"\xE4\xBD\xA0\xE5\xA5\xBD", "\xE4\xB8\x96\xE7\x95\x8C"};
+    WrappedStrings byOne = {"\xE4\xBD\xA0", "\xE5\xA5\xBD", "\xE4\xB8\x96", "\xE7\x95\x8C"};
+    EXPECT_EQ(byTwo, WrapStringUtf8(text, 4));
+    EXPECT_EQ(byOne, WrapStringUtf8(text, 3));
+}
+
+TEST(WrapStringUtf8, WideCharacterWiderThanLimit)
+{
+    WrappedStrings expected = {"\xE4\xBD\xA0", "\xE5\xA5\xBD"};
+    ASSERT_EQ(expected, WrapStringUtf8("\xE4\xBD\xA0\xE5\xA5\xBD", 1));
+}
+
+TEST(WrapStringUtf8, KeepsCombiningMarksWithBase)
+{
+    const std::string accented = "e\xCC\x81";
+    WrappedStrings expected = {accented + accented, accented};
+    ASSERT_EQ(expected, WrapStringUtf8(accented + accented + accented, 2));
+}
+
+TEST(WrapStringUtf8, KeepsZeroWidthJoinerSequences)
+{
+    const std::string family = "\xF0\x9F\x91\xA8\xE2\x80\x8D\xF0\x9F\x91\xA9";
+    WrappedStrings expected = {family, family};
+    ASSERT_EQ(expected, WrapStringUtf8(family + family, 2));
+}
+
+TEST(WrapStringUtf8, BreaksAtSpaceAfterWideCharacters)
+{
+    WrappedStrings expected = {"\xE4\xBD\xA0\xE5\xA5\xBD", "ab"};
+    ASSERT_EQ(expected, WrapStringUtf8("\xE4\xBD\xA0\xE5\xA5\xBD ab", 5));
+}
+
+TEST(WrapStringBenchmark, DISABLED_Utf8OverheadOverBytes)
+{
+    const size_t columns = 80;
+    const std::string ascii = GenerateText(1 << 20, 150, 11);
+
+    // Same words with Cyrillic and CJK letters mixed in
+    std::string utf8;
+    unsigned int seed = 13;
+    for (char c : ascii)
+    {
+        seed = seed * 1103515245 + 12345;
+        const unsigned int random = (seed >> 16) % 4;
+        if (c == ' ' || random == 0)
+        {
+            utf8 += c;
+        }
+        else if (random == 1)
+        {
+            utf8 += "\xD0";
+            utf8 += static_cast<char>(0xB0 + (c - 'a') % 16);
+        }
+        else
+        {
+            utf8 += "\xE4\xB8";
+            utf8 += static_cast<char>(0x80 + (c - 'a'));
+        }
+    }
+
+    auto measure = [columns](const std::string& kind, const std::string& text)
+    {
+        size_t lines = 0;
+        auto countLine = [&lines](const char*, size_t)
+        {
+            ++lines;
+        };
+        const double bytes = GetMegabytesPerSecond(text.size(), [&]()
+        {
+            WrapLines(text.data(), text.size(), columns, countLine);
+        });
+        const double displayWidth = GetMegabytesPerSecond(text.size(), [&]()
+        {
+            WrapUtf8Lines(text.data(), text.size(), columns, countLine);
+        });
+        ReportMegabytesPerSecond("WrapLines, " + kind, bytes);
+        ReportMegabytesPerSecond("WrapUtf8Lines, " + kind, displayWidth);
+        std::cout << "[ MEASURED ] WrapUtf8Lines takes " << bytes / displayWidth << " times longer on " << kind << std::endl;
+        EXPECT_GT(lines, 0u);
+    };
+    measure("ASCII", ascii);
+    measure("UTF-8", utf8);
+}
+
+long long GetRaggedness(const WrappedStrings& lines, size_t wrapLength)
+{
+    long long raggedness = 0;
+    for (size_t i = 0; i + 1 < lines.size(); ++i)
+    {
+        const long long space = static_cast<long long>(wrapLength) - static_cast<long long>(lines[i].size());
+        raggedness += space * space;
+    }
+    return raggedness;
+}
+
+// Tries every line start for every word
+long long GetMinimumRaggedness(const std::vector<Word>& words, size_t wrapLength)
+{
+    const long long tooLong = std::numeric_limits<long long>::max() / 4;
+    std::vector<long long> costs(words.size() + 1, tooLong);
+    costs[0] = 0;
+    long long best = words.empty() ? 0 : tooLong;
+    for (size_t first = 0; first < words.size(); ++first)
+    {
+        long long length = -1;
+        for (size_t last = first + 1; last <= words.size(); ++last)
+        {
+            length += static_cast<long long>(words[last - 1].length) + 1;
+            if (length > static_cast<long long>(wrapLength))
+            {
+                break;
+            }
+            const long long space = static_cast<long long>(wrapLength) - length;
+            if (last == words.size())
+            {
+                best = std::min(best, costs[first]);
+            }
+            else
+            {
+                costs[last] = std::min(costs[last], costs[first] + space * space);
+            }
+        }
+    }
+    return best;
+}
+
+TEST(WrapStringBalanced, EmptyString)
+{
+    ASSERT_EQ(WrappedStrings(), WrapStringBalanced("", 5));
+    ASSERT_EQ(WrappedStrings(), WrapStringBalanced("   ", 5));
+    ASSERT_EQ(WrappedStrings(), WrapStringBalanced("1 2", 0));
+}
+
+TEST(WrapStringBalanced, StringShorterWrapNumber)
+{
+    ASSERT_EQ(WrappedStrings{"as df"}, WrapStringBalanced("as  df", 8));
+}
+
+TEST(WrapStringBalanced, WordLongerThanWrapNumber)
+{
+    WrappedStrings expected = {"12", "34", "56"};
+    ASSERT_EQ(expected, WrapStringBalanced("123456", 2));
+}
+
+TEST(WrapStringBalanced, LessRaggedThanGreedy)
+{
+    WrappedStrings greedy = {"aaa bb", "cc", "ddddd"};
+    WrappedStrings balanced = {"aaa", "bb cc", "ddddd"};
+    ASSERT_EQ(greedy, WrapString("aaa bb cc ddddd", 6));
+    ASSERT_EQ(balanced, WrapStringBalanced("aaa bb cc ddddd", 6));
+}
+
+TEST(WrapStringBalanced, SameRaggednessAsExhaustiveSearch)
+{
+    unsigned int seed = 11;
+    for (size_t test = 0; test < 200; ++test)
+    {
+        std::string text;
+        for (size_t i = 0; i < 60; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            text += (seed >> 16) % 5 == 0 ? ' ' : 'x';
+        }
+        const size_t wrapLength = 1 + test % 17;
+
+        const WrappedStrings lines = WrapStringBalanced(text, wrapLength);
+        for (const std::string& line : lines)
+        {
+            ASSERT_LE(line.size(), wrapLength);
+        }
+        ASSERT_EQ(GetMinimumRaggedness(SplitWords(text, wrapLength), wrapLength), GetRaggedness(lines, wrapLength));
+    }
+}
+
+std::string WrapDocumentSequentially(const std::string& text, size_t wrapLength)
+{
+    std::vector<std::string> paragraphs(1);
+    std::istringstream input(text);
+    std::string line;
+    while (std::getline(input, line))
+    {
+        if (line.find_first_not_of(' ') == std::string::npos)
+        {
+            paragraphs.push_back("");
+        }
+        else
+        {
+            paragraphs.back() += (paragraphs.back().empty() ? "" : " ") + line;
+        }
+    }
+
+    std::string result;
+    for (const std::string& paragraph : paragraphs)
+    {
+        if (paragraph.empty())
+        {
+            continue;
+        }
+        result += result.empty() ? "" : "\n";
+        for (const std::string& wrapped : WrapString(paragraph, wrapLength))
+        {
+            result += wrapped + "\n";
+        }
+    }
+    return result;
+}
+
+TEST(SplitParagraphs, BlankLinesSeparateParagraphs)
+{
+    const std::string text = "\n  \n12\n34\n\n \n56\n\n";
+    const std::vector<TextSpan> paragraphs = SplitParagraphs(text);
+    ASSERT_EQ(2u, paragraphs.size());
+    EXPECT_EQ("12\n34", std::string(paragraphs[0].begin, paragraphs[0].length));
+    EXPECT_EQ("56", std::string(paragraphs[1].begin, paragraphs[1].length));
+}
+
+TEST(WrapDocument, EmptyDocument)
+{
+    ASSERT_EQ("", WrapDocument("", 10, 4));
+    ASSERT_EQ("", WrapDocument(" \n\n", 10, 4));
+}
+
+TEST(WrapDocument, KeepsParagraphs)
+{
+    ASSERT_EQ("12\n34\n\n56\n", WrapDocument("12 34\n\n56", 3, 2));
+}
+
+TEST(WrapDocument, ReflowsHardWrappedParagraph)
+{
+    ASSERT_EQ("12 34\n56\n\n78\n", WrapDocument("12\n34\n56\n  \n\n78\n", 5, 2));
+}
+
+TEST(WrapDocument, SameAsSequential)
+{
+    std::string text;
+    unsigned int seed = 3;
+    for (size_t i = 0; i < 200000; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        const unsigned int random = (seed >> 16) % 400;
+        text += random < 8 ? '\n' : random < 60 ? ' ' : static_cast<char>('a' + random % 26);
+    }
+
+    const std::string expected = WrapDocumentSequentially(text, 40);
+    for (size_t threadsCount = 1; threadsCount <= 8; ++threadsCount)
+    {
+        ASSERT_EQ(expected, WrapDocument(text, 40, threadsCount));
+    }
+}
+
+TEST(WrapDocumentBenchmark, DISABLED_ScalesWithThreads)
+{
+    // About 16 MiB in paragraphs of a few hundred characters, hard wrapped at 60 columns
+    std::string corpus;
+    unsigned int seed = 17;
+    while (corpus.size() < (16u << 20))
+    {
+        seed = seed * 1103515245 + 12345;
+        std::string paragraph = GenerateText(200 + (seed >> 16) % 800, 150, seed);
+        for (size_t i = 60; i < paragraph.size(); i += 60)
+        {
+            paragraph[i] = '\n';
+        }
+        corpus += paragraph + "\n\n";
+    }
+
+    const size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    double singleThread = 0;
+    for (size_t threadsCount = 1; threadsCount <= std::max<size_t>(hardwareThreads, 8); threadsCount *= 2)
+    {
+        size_t outputSize = 0;
+        const double megabytesPerSecond = GetMegabytesPerSecond(corpus.size(), [&]()
+        {
+            outputSize += WrapDocument(corpus, 80, threadsCount).size();
+        });
+        singleThread = threadsCount == 1 ? megabytesPerSecond : singleThread;
+        ReportMegabytesPerSecond("WrapDocument, threads: " + std::to_string(threadsCount), megabytesPerSecond);
+        std::cout << "[ MEASURED ] Speedup over one thread: " << megabytesPerSecond / singleThread << std::endl;
+        EXPECT_GT(outputSize, 0u);
+    }
+}
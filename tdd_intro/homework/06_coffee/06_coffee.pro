@@ -1,7 +1,7 @@
 include(../../gmock.pri)
 
 TEMPLATE = app
-CONFIG += console c++11
+CONFIG += console c++11 thread
 CONFIG -= app_bundle
 CONFIG -= qt
 
@@ -16,6 +16,41 @@ Implement worked coffee machine using ISourceOfIngredients to controll the proce
 
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+enum class Ingredient
+{
+    CupSize,
+    // Heats or cools the water before brewing, nothing is added to the cup
+    WaterTemperature,
+    Water,
+    Sugar,
+    Coffee,
+    Milk,
+    MilkFoam,
+    Chocolate,
+    Cream
+};
+
+// One call to ISourceOfIngredients. Temperature is set only for water and water temperature commands.
+struct IngredientCommand
+{
+    Ingredient ingredient;
+    int gram;
+    int temperature;
+};
 
 class ISourceOfIngredients
 {
@@ -29,6 +64,56 @@ public:
     virtual void AddMilkFoam(int gram) = 0;
     virtual void AddChocolate(int gram) = 0;
     virtual void AddCream(int gram) = 0;
+
+    // Heats or cools the water before brewing. Sources which do not control the heater ignore it.
+    virtual void SetWaterTemperature(int /*temperature*/)
+    {
+    }
+
+    // Executes the commands in order. Sources able to take the whole batch at once should override it,
+    // by default each command is forwarded to the corresponding method.
+    virtual void Execute(const IngredientCommand* commands, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            ExecuteCommand(commands[i]);
+        }
+    }
+
+private:
+    void ExecuteCommand(const IngredientCommand& command)
+    {
+        switch (command.ingredient)
+        {
+        case Ingredient::CupSize:
+            SetCupSize(command.gram);
+            break;
+        case Ingredient::WaterTemperature:
+            SetWaterTemperature(command.temperature);
+            break;
+        case Ingredient::Water:
+            AddWater(command.gram, command.temperature);
+            break;
+        case Ingredient::Sugar:
+            AddSugar(command.gram);
+            break;
+        case Ingredient::Coffee:
+            AddCoffee(command.gram);
+            break;
+        case Ingredient::Milk:
+            AddMilk(command.gram);
+            break;
+        case Ingredient::MilkFoam:
+            AddMilkFoam(command.gram);
+            break;
+        case Ingredient::Chocolate:
+            AddChocolate(command.gram);
+            break;
+        case Ingredient::Cream:
+            AddCream(command.gram);
+            break;
+        }
+    }
 };
 
 
@@ -40,7 +125,94 @@ enum Cup
 
 enum Coffee
 {
-    Americano
+    Americano,
+    Cappuccino,
+    Latte,
+    Marochino
+};
+
+const size_t s_cupsCount = 2;
+const size_t s_coffeesCount = 4;
+
+// Share of the cup taken by the ingredient: parts/of
+struct Portion
+{
+    Ingredient ingredient;
+    int parts;
+    int of;
+};
+
+const size_t s_maxPortions = 3;
+
+struct Recipe
+{
+    // Temperature of the water the machine heats up for the coffee, 0 if not specified
+    int waterTemperature;
+    size_t portionsCount;
+    Portion portions[s_maxPortions];
+};
+
+constexpr int s_cupGrams[s_cupsCount] = {100, 140};
+
+constexpr Recipe s_recipes[s_coffeesCount] = {
+    // americano: water & coffee 1:3, water temp 60C
+    {60, 2, {{Ingredient::Coffee, 3, 4}, {Ingredient::Water, 1, 4}}},
+    // cappuccino: milk & coffee & milk foam 1:3, 1:3, 1:3, water temp 80C
+    {80, 3, {{Ingredient::Milk, 1, 3}, {Ingredient::Coffee, 1, 3}, {Ingredient::MilkFoam, 1, 3}}},
+    // latte: milk & coffee & milk foam 1:4, 1:2, 1:4, water temp 90C
+    {90, 3, {{Ingredient::Milk, 1, 4}, {Ingredient::Coffee, 1, 2}, {Ingredient::MilkFoam, 1, 4}}},
+    // marochino: chocolate & coffee & milk foam 1:4, 1:4, 1:4 and 1:4 is empty
+    {0, 3, {{Ingredient::Chocolate, 1, 4}, {Ingredient::Coffee, 1, 4}, {Ingredient::MilkFoam, 1, 4}}}
+};
+
+// Cup size, water temperature and portions
+const size_t s_maxProgramSize = s_maxPortions + 2;
+
+// Sequence of commands producing one coffee of one cup size
+struct CoffeeProgram
+{
+    size_t size;
+    IngredientCommand commands[s_maxProgramSize];
+};
+
+constexpr size_t GetHeatCommandsCount(const Recipe& recipe)
+{
+    return recipe.waterTemperature != 0 ? 1 : 0;
+}
+
+constexpr IngredientCommand CompilePortion(int cupGram, const Recipe& recipe, size_t portion)
+{
+    return portion < recipe.portionsCount
+            ? IngredientCommand{recipe.portions[portion].ingredient,
+                                cupGram * recipe.portions[portion].parts / recipe.portions[portion].of,
+                                recipe.portions[portion].ingredient == Ingredient::Water ? recipe.waterTemperature : 0}
+            : IngredientCommand{Ingredient::CupSize, 0, 0};
+}
+
+constexpr IngredientCommand CompileCommand(int cupGram, const Recipe& recipe, size_t command)
+{
+    return command == 0 ? IngredientCommand{Ingredient::CupSize, cupGram, 0}
+         : command <= GetHeatCommandsCount(recipe) ? IngredientCommand{Ingredient::WaterTemperature, 0, recipe.waterTemperature}
+         : CompilePortion(cupGram, recipe, command - 1 - GetHeatCommandsCount(recipe));
+}
+
+constexpr CoffeeProgram CompileProgram(Cup cup, Coffee coffee)
+{
+    return CoffeeProgram{1 + GetHeatCommandsCount(s_recipes[coffee]) + s_recipes[coffee].portionsCount,
+                         {CompileCommand(s_cupGrams[cup], s_recipes[coffee], 0),
+                          CompileCommand(s_cupGrams[cup], s_recipes[coffee], 1),
+                          CompileCommand(s_cupGrams[cup], s_recipes[coffee], 2),
+                          CompileCommand(s_cupGrams[cup], s_recipes[coffee], 3),
+                          CompileCommand(s_cupGrams[cup], s_recipes[coffee], 4)}};
+}
+
+// All programs are compiled ahead of time, grams are rounded down.
+// The water is brought to the recipe temperature right after the cup is set, before anything is brewed.
+constexpr CoffeeProgram s_programs[s_cupsCount][s_coffeesCount] = {
+    {CompileProgram(Normal, Americano), CompileProgram(Normal, Cappuccino),
+     CompileProgram(Normal, Latte), CompileProgram(Normal, Marochino)},
+    {CompileProgram(Big, Americano), CompileProgram(Big, Cappuccino),
+     CompileProgram(Big, Latte), CompileProgram(Big, Marochino)}
 };
 
 class MockSourceOfIngredients : public ISourceOfIngredients
@@ -56,23 +228,675 @@ public:
     MOCK_METHOD1(AddCream, void(int));
 };
 
+// Source which also controls the water heater
+class MockHeatingSourceOfIngredients : public MockSourceOfIngredients
+{
+public:
+    MOCK_METHOD1(SetWaterTemperature, void(int));
+};
+
+// Source which takes whole programs at once, individual calls are not expected
+class MockBatchSourceOfIngredients : public MockSourceOfIngredients
+{
+public:
+    MOCK_METHOD2(Execute, void(const IngredientCommand*, size_t));
+};
+
+const size_t s_ingredientsCount = static_cast<size_t>(Ingredient::Cream) + 1;
+
+// Grams of every ingredient left, shared by machines brewing concurrently.
+// Reservation is lock-free and all or nothing. Every ingredient is one atomic word with the grams in stock
+// and the grams held by reservations in progress, ingredients are taken in a fixed order with compare-and-swap.
+// If an ingredient is short only because other reservations hold it, whatever was taken is given back
+// and the reservation starts over, so it is rejected only if the stock is short even with those grams returned.
+class IngredientsInventory
+{
+public:
+    IngredientsInventory()
+    {
+        for (std::atomic<uint64_t>& stock : m_stock)
+        {
+            stock = 0;
+        }
+    }
+
+    // Stock and held grams of an ingredient together stay within int, so they never carry into each other
+    void Refill(const Ingredient ingredient, const int gram)
+    {
+        if (gram < 0)
+        {
+            throw std::invalid_argument("Refill must not be negative");
+        }
+
+        std::atomic<uint64_t>& word = m_stock[static_cast<size_t>(ingredient)];
+        uint64_t current = word.load();
+        do
+        {
+            if ((current & s_gramsMask) + (current >> s_heldShift) + static_cast<uint64_t>(gram) > INT_MAX)
+            {
+                throw std::overflow_error("Too much of the ingredient in stock");
+            }
+        }
+        while (!word.compare_exchange_weak(current, current + static_cast<uint64_t>(gram)));
+    }
+
+    // Grams held by reservations in progress are not in stock
+    int GetStock(const Ingredient ingredient) const
+    {
+        return static_cast<int>(m_stock[static_cast<size_t>(ingredient)] & s_gramsMask);
+    }
+
+    // Takes grams of all ingredients of the commands or nothing, cup size and water temperature commands are skipped
+    bool Reserve(const IngredientCommand* commands, size_t count)
+    {
+        uint64_t grams[s_ingredientsCount] = {};
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (IsStocked(commands[i].ingredient))
+            {
+                grams[static_cast<size_t>(commands[i].ingredient)] += static_cast<uint64_t>(commands[i].gram);
+            }
+        }
+
+        while (true)
+        {
+            TakeResult result = TakeResult::Taken;
+            size_t taken = 0;
+            for (; taken < s_ingredientsCount; ++taken)
+            {
+                if (grams[taken] != 0 && (result = Take(taken, grams[taken])) != TakeResult::Taken)
+                {
+                    break;
+                }
+            }
+
+            for (size_t i = 0; i < taken; ++i)
+            {
+                // Held grams are dropped, on failure they also go back to stock
+                m_stock[i] -= (grams[i] << s_heldShift) - (result == TakeResult::Taken ? 0 : grams[i]);
+            }
+
+            if (result != TakeResult::HeldByOthers)
+            {
+                return result == TakeResult::Taken;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void Release(const IngredientCommand* commands, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (IsStocked(commands[i].ingredient))
+            {
+                m_stock[static_cast<size_t>(commands[i].ingredient)] += static_cast<uint64_t>(commands[i].gram);
+            }
+        }
+    }
+
+private:
+    enum class TakeResult
+    {
+        Taken,
+        Short,
+        // Short now, but enough if other reservations give back what they hold
+        HeldByOthers
+    };
+
+    static bool IsStocked(const Ingredient ingredient)
+    {
+        return ingredient != Ingredient::CupSize && ingredient != Ingredient::WaterTemperature;
+    }
+
+    // Moves grams from stock to held
+    TakeResult Take(size_t ingredient, uint64_t gram)
+    {
+        std::atomic<uint64_t>& word = m_stock[ingredient];
+        uint64_t current = word.load();
+        while (true)
+        {
+            const uint64_t stock = current & s_gramsMask;
+            if (stock < gram)
+            {
+                return stock + (current >> s_heldShift) < gram ? TakeResult::Short : TakeResult::HeldByOthers;
+            }
+            if (word.compare_exchange_weak(current, current - gram + (gram << s_heldShift)))
+            {
+                return TakeResult::Taken;
+            }
+        }
+    }
+
+private:
+    // Grams in stock in the low half of the word, grams held in the high half
+    static const unsigned s_heldShift = 32;
+    static const uint64_t s_gramsMask = 0xFFFFFFFF;
+
+    std::atomic<uint64_t> m_stock[s_ingredientsCount];
+};
+
 class CoffeeMachine
 {
 public:
-    CoffeeMachine(ISourceOfIngredients& source) : m_source(source)
+    // Without inventory the stock of ingredients is considered endless
+    CoffeeMachine(ISourceOfIngredients& source, IngredientsInventory* inventory = nullptr)
+        : m_source(source)
+        , m_inventory(inventory)
     {
 
     }
-    void CreateCoffee(const Cup cup, const Coffee coffee)
+    // Returns false without touching the source if there are not enough ingredients
+    bool CreateCoffee(const Cup cup, const Coffee coffee)
     {
-        m_source.AddCoffee(0);
-        m_source.SetCupSize(0);
-        m_source.AddWater(0, 0);
+        const CoffeeProgram& program = s_programs[cup][coffee];
+        if (m_inventory != nullptr && !m_inventory->Reserve(program.commands, program.size))
+        {
+            return false;
+        }
+
+        try
+        {
+            m_source.Execute(program.commands, program.size);
+        }
+        catch (...)
+        {
+            if (m_inventory != nullptr)
+            {
+                m_inventory->Release(program.commands, program.size);
+            }
+            throw;
+        }
+        return true;
     }
 private:
     ISourceOfIngredients& m_source;
+    IngredientsInventory* m_inventory;
+};
+
+
+// Bounded multi-producer multi-consumer queue without locks (Dmitry Vyukov's algorithm).
+// Every cell has a sequence number telling whether it waits for the next push or the next pop,
+// so producers and consumers only compete for their own position counter.
+template<typename T, size_t Capacity>
+class BoundedQueue
+{
+public:
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    BoundedQueue() : m_cells(new Cell[Capacity])
+    {
+        for (size_t i = 0; i < Capacity; ++i)
+        {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns false if the queue is full
+    bool TryPush(const T& value)
+    {
+        size_t position = m_pushPosition.value.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell& cell = m_cells[position & (Capacity - 1)];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == position)
+            {
+                if (m_pushPosition.value.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (static_cast<std::ptrdiff_t>(sequence - position) < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = m_pushPosition.value.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the queue is empty
+    bool TryPop(T& value)
+    {
+        size_t position = m_popPosition.value.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell& cell = m_cells[position & (Capacity - 1)];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == position + 1)
+            {
+                if (m_popPosition.value.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(position + Capacity, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (static_cast<std::ptrdiff_t>(sequence - (position + 1)) < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = m_popPosition.value.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Number of values, stale if other threads push or pop meanwhile
+    size_t GetSize() const
+    {
+        const size_t popPosition = m_popPosition.value.load(std::memory_order_relaxed);
+        const size_t pushPosition = m_pushPosition.value.load(std::memory_order_relaxed);
+        return pushPosition > popPosition ? pushPosition - popPosition : 0;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static const size_t s_cacheLineSize = 64;
+
+    // Producers and consumers do not share a cache line
+    struct Position
+    {
+        std::atomic<size_t> value{0};
+        char padding[s_cacheLineSize - sizeof(std::atomic<size_t>)];
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    Position m_pushPosition;
+    Position m_popPosition;
+};
+
+struct SchedulerReport
+{
+    size_t orders = 0;
+    double ordersPerSecond = 0;
+    std::chrono::microseconds p99Latency = std::chrono::microseconds(0);
+    // Orders which needed the water heated to another temperature than the previous order of the machine
+    size_t heatUps = 0;
+    // Orders not brewed because of lack of ingredients, they are not counted in other fields
+    size_t rejected = 0;
+};
+
+const std::chrono::milliseconds s_parkTimeout(1);
+
+// Serves a stream of orders on several machines in parallel, one thread per machine.
+// Orders wait in a lock-free queue per recipe. An idle machine prefetches a few orders of one recipe,
+// preferring the recipes it can brew without heating the water up and then the longest queue.
+// When all recipe queues are empty, it steals prefetched orders from other machines.
+// Machines without work sleep until an order is submitted, at most s_parkTimeout.
+class OrderScheduler
+{
+public:
+    explicit OrderScheduler(const std::vector<CoffeeMachine*>& machines)
+    {
+        for (CoffeeMachine* machine : machines)
+        {
+            m_machines.emplace_back(new Machine(machine, m_machines.size()));
+        }
+    }
+
+    ~OrderScheduler()
+    {
+        if (m_running)
+        {
+            Stop();
+        }
+    }
+
+    // Returns false if too many orders of the coffee are waiting
+    bool Submit(const Cup cup, const Coffee coffee)
+    {
+        if (!m_orders[coffee].TryPush(Order{cup, coffee, std::chrono::steady_clock::now()}))
+        {
+            return false;
+        }
+        m_wakeUp.notify_one();
+        return true;
+    }
+
+    // Machines keep serving orders, including ones submitted later, until Stop
+    void Start()
+    {
+        if (m_running)
+        {
+            throw std::runtime_error("Scheduler is already running");
+        }
+
+        m_running = true;
+        m_stopping = false;
+        m_start = std::chrono::steady_clock::now();
+        for (std::unique_ptr<Machine>& machine : m_machines)
+        {
+            machine->temperature = 0;
+            machine->latencies.clear();
+            machine->heatUps = 0;
+            machine->rejected = 0;
+            machine->thread = std::thread(&OrderScheduler::Serve, this, std::ref(*machine));
+        }
+    }
+
+    // Brews all orders submitted before the call and returns statistics since Start
+    SchedulerReport Stop()
+    {
+        if (!m_running)
+        {
+            throw std::runtime_error("Scheduler is not running");
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_parkMutex);
+            m_stopping = true;
+        }
+        m_wakeUp.notify_all();
+
+        std::vector<std::chrono::microseconds> latencies;
+        SchedulerReport report;
+        for (std::unique_ptr<Machine>& machine : m_machines)
+        {
+            machine->thread.join();
+            latencies.insert(latencies.end(), machine->latencies.begin(), machine->latencies.end());
+            report.heatUps += machine->heatUps;
+            report.rejected += machine->rejected;
+        }
+        m_running = false;
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+
+        report.orders = latencies.size();
+        if (!latencies.empty())
+        {
+            std::sort(latencies.begin(), latencies.end());
+            report.p99Latency = latencies[(latencies.size() * 99 + 99) / 100 - 1];
+            report.ordersPerSecond = elapsed.count() > 0 ? report.orders / elapsed.count() : 0;
+        }
+        return report;
+    }
+
+    // Brews all submitted orders and returns statistics of this run
+    SchedulerReport Run()
+    {
+        Start();
+        return Stop();
+    }
+
+private:
+    struct Order
+    {
+        Cup cup;
+        Coffee coffee;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    static const size_t s_queueCapacity = 1 << 16;
+    static const size_t s_prefetchOrders = 4;
+
+    struct Machine
+    {
+        Machine(CoffeeMachine* coffeeMachine, size_t machineIndex)
+            : machine(coffeeMachine)
+            , index(machineIndex)
+        {
+            unshared.reserve(s_prefetchOrders);
+        }
+
+        CoffeeMachine* machine;
+        size_t index;
+        // Prefetched orders of one recipe, taken by the machine and by idle machines
+        BoundedQueue<Order, s_prefetchOrders> orders;
+        // Prefetched orders which did not fit into the machine queue while a thief was still taking
+        // an order from it, taken only by the machine itself
+        std::vector<Order> unshared;
+        std::thread thread;
+        // Statistics, read by Stop after the thread is joined
+        int temperature = 0;
+        std::vector<std::chrono::microseconds> latencies;
+        size_t heatUps = 0;
+        size_t rejected = 0;
+    };
+
+    void Serve(Machine& machine)
+    {
+        while (true)
+        {
+            // Orders submitted before Stop are visible to the search which follows
+            const bool stopping = m_stopping;
+            Order order;
+            if (Take(machine, order))
+            {
+                Brew(machine, order);
+            }
+            else if (stopping)
+            {
+                return;
+            }
+            else
+            {
+                std::unique_lock<std::mutex> lock(m_parkMutex);
+                if (!m_stopping)
+                {
+                    m_wakeUp.wait_for(lock, s_parkTimeout);
+                }
+            }
+        }
+    }
+
+    bool Take(Machine& machine, Order& order)
+    {
+        if (!machine.unshared.empty())
+        {
+            order = machine.unshared.back();
+            machine.unshared.pop_back();
+            return true;
+        }
+        return machine.orders.TryPop(order) || Prefetch(machine, order) || Steal(machine, order);
+    }
+
+    // Takes the first order of a batch of one recipe, the rest goes to the machine queue
+    bool Prefetch(Machine& machine, Order& order)
+    {
+        unsigned emptyQueues = 0;
+        size_t coffee = s_coffeesCount;
+        while (true)
+        {
+            bool heatUp = true;
+            size_t waiting = 0;
+            coffee = s_coffeesCount;
+            for (size_t candidate = 0; candidate < s_coffeesCount; ++candidate)
+            {
+                const size_t candidateWaiting = (emptyQueues >> candidate) & 1u ? 0 : m_orders[candidate].GetSize();
+                const bool candidateHeatUp = NeedsHeatUp(machine, static_cast<Coffee>(candidate));
+                if (candidateWaiting != 0 && (coffee == s_coffeesCount || (heatUp && !candidateHeatUp) ||
+                                              (heatUp == candidateHeatUp && candidateWaiting > waiting)))
+                {
+                    coffee = candidate;
+                    heatUp = candidateHeatUp;
+                    waiting = candidateWaiting;
+                }
+            }
+
+            if (coffee == s_coffeesCount)
+            {
+                return false;
+            }
+            if (m_orders[coffee].TryPop(order))
+            {
+                break;
+            }
+            emptyQueues |= 1u << coffee;
+        }
+
+        Order next;
+        for (size_t i = 1; i < s_prefetchOrders && m_orders[coffee].TryPop(next); ++i)
+        {
+            if (!machine.orders.TryPush(next))
+            {
+                machine.unshared.push_back(next);
+            }
+        }
+        return true;
+    }
+
+    bool Steal(Machine& thief, Order& order)
+    {
+        for (size_t i = 1; i < m_machines.size(); ++i)
+        {
+            if (m_machines[(thief.index + i) % m_machines.size()]->orders.TryPop(order))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool NeedsHeatUp(const Machine& machine, const Coffee coffee)
+    {
+        const int temperature = s_recipes[coffee].waterTemperature;
+        return temperature != 0 && temperature != machine.temperature;
+    }
+
+    void Brew(Machine& machine, const Order& order)
+    {
+        if (!machine.machine->CreateCoffee(order.cup, order.coffee))
+        {
+            ++machine.rejected;
+            return;
+        }
+
+        if (NeedsHeatUp(machine, order.coffee))
+        {
+            ++machine.heatUps;
+            machine.temperature = s_recipes[order.coffee].waterTemperature;
+        }
+        machine.latencies.push_back(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - order.submitted));
+    }
+
+private:
+    std::vector<std::unique_ptr<Machine>> m_machines;
+    BoundedQueue<Order, s_queueCapacity> m_orders[s_coffeesCount];
+    bool m_running = false;
+    std::atomic<bool> m_stopping{false};
+    std::chrono::steady_clock::time_point m_start;
+    std::mutex m_parkMutex;
+    std::condition_variable m_wakeUp;
+};
+
+// Time the machine spends on every step
+struct SimulationTimings
+{
+    std::chrono::milliseconds cupChange = std::chrono::milliseconds(2000);
+    // Water and milk
+    std::chrono::milliseconds pumpPerGram = std::chrono::milliseconds(20);
+    // Coffee, sugar, chocolate and cream
+    std::chrono::milliseconds dosePerGram = std::chrono::milliseconds(50);
+    std::chrono::milliseconds foamPerGram = std::chrono::milliseconds(100);
+    // Heating or cooling the water by one degree
+    std::chrono::milliseconds heatPerDegree = std::chrono::milliseconds(300);
+};
+
+class VirtualClock
+{
+public:
+    std::chrono::milliseconds Now() const
+    {
+        return m_now;
+    }
+    void Advance(std::chrono::milliseconds duration)
+    {
+        m_now += duration;
+    }
+
+private:
+    std::chrono::milliseconds m_now = std::chrono::milliseconds(0);
+};
+
+// Source which does nothing but counts how long the real machine would be busy.
+// The water is heated by water temperature commands and by water added at another temperature.
+class SimulatedSourceOfIngredients : public ISourceOfIngredients
+{
+public:
+    explicit SimulatedSourceOfIngredients(const SimulationTimings& timings = SimulationTimings(),
+                                          int waterTemperature = 20)
+        : m_timings(timings)
+        , m_waterTemperature(waterTemperature)
+    {
+    }
+
+    void SetCupSize(int) override
+    {
+        m_clock.Advance(m_timings.cupChange);
+    }
+    void SetWaterTemperature(int temperature) override
+    {
+        Heat(temperature);
+    }
+    void AddWater(int gram, int temperature) override
+    {
+        Heat(temperature);
+        m_clock.Advance(m_timings.pumpPerGram * gram);
+    }
+    void AddSugar(int gram) override
+    {
+        m_clock.Advance(m_timings.dosePerGram * gram);
+    }
+    void AddCoffee(int gram) override
+    {
+        m_clock.Advance(m_timings.dosePerGram * gram);
+    }
+    void AddMilk(int gram) override
+    {
+        m_clock.Advance(m_timings.pumpPerGram * gram);
+    }
+    void AddMilkFoam(int gram) override
+    {
+        m_clock.Advance(m_timings.foamPerGram * gram);
+    }
+    void AddChocolate(int gram) override
+    {
+        m_clock.Advance(m_timings.dosePerGram * gram);
+    }
+    void AddCream(int gram) override
+    {
+        m_clock.Advance(m_timings.dosePerGram * gram);
+    }
+
+    std::chrono::milliseconds GetElapsed() const
+    {
+        return m_clock.Now();
+    }
+
+    int GetWaterTemperature() const
+    {
+        return m_waterTemperature;
+    }
+
+private:
+    void Heat(int temperature)
+    {
+        m_clock.Advance(m_timings.heatPerDegree * std::abs(temperature - m_waterTemperature));
+        m_waterTemperature = temperature;
+    }
+
+private:
+    const SimulationTimings m_timings;
+    VirtualClock m_clock;
+    int m_waterTemperature;
 };
 
+double GetOrdersPerHour(size_t orders, std::chrono::milliseconds elapsed)
+{
+    return elapsed.count() > 0 ? orders * 3600000.0 / elapsed.count() : 0;
+}
 
 // Architecture
 // Class CoffeMachine
@@ -117,3 +941,872 @@ TEST(CoffeeMachine, Americano)
 
     cm.CreateCoffee(Cup::Normal, Coffee::Americano);
 }
+
+TEST(CoffeeMachine, BigAmericano)
+{
+    MockSourceOfIngredients si;
+    CoffeeMachine cm(si);
+
+    EXPECT_CALL(si, SetCupSize(140)).Times(1);
+    EXPECT_CALL(si, AddCoffee(105)).Times(1);
+    EXPECT_CALL(si, AddWater(35, 60)).Times(1);
+
+    cm.CreateCoffee(Cup::Big, Coffee::Americano);
+}
+
+//- cappuccino - milk & coffee & milk foam 1:3, 1:3, 1:3. Water temp 80C
+TEST(CoffeeMachine, Cappuccino)
+{
+    MockSourceOfIngredients si;
+    CoffeeMachine cm(si);
+
+    EXPECT_CALL(si, SetCupSize(100)).Times(1);
+    EXPECT_CALL(si, AddMilk(33)).Times(1);
+    EXPECT_CALL(si, AddCoffee(33)).Times(1);
+    EXPECT_CALL(si, AddMilkFoam(33)).Times(1);
+
+    cm.CreateCoffee(Cup::Normal, Coffee::Cappuccino);
+}
+
+TEST(CoffeeMachine, BigCappuccino)
+{
+    MockSourceOfIngredients si;
+    CoffeeMachine cm(si);
+
+    EXPECT_CALL(si, SetCupSize(140)).Times(1);
+    EXPECT_CALL(si, AddMilk(46)).Times(1);
+    EXPECT_CALL(si, AddCoffee(46)).Times(1);
+    EXPECT_CALL(si, AddMilkFoam(46)).Times(1);
+
+    cm.CreateCoffee(Cup::Big, Coffee::Cappuccino);
+}
+
+//- latte - milk & coffee & milk foam 1:4, 1:2, 1:4. Water temp 90C
+TEST(CoffeeMachine, Latte)
+{
+    MockSourceOfIngredients si;
+    CoffeeMachine cm(si);
+
+    EXPECT_CALL(si, SetCupSize(100)).Times(1);
+    EXPECT_CALL(si, AddMilk(25)).Times(1);
+    EXPECT_CALL(si, AddCoffee(50)).Times(1);
+    EXPECT_CALL(si, AddMilkFoam(25)).Times(1);
+
+    cm.CreateCoffee(Cup::Normal, Coffee::Latte);
+}
+
+TEST(CoffeeMachine, BigLatte)
+{
+    MockSourceOfIngredients si;
+    CoffeeMachine cm(si);
+
+    EXPECT_CALL(si, SetCupSize(140)).Times(1);
+    EXPECT_CALL(si, AddMilk(35)).Times(1);
+    EXPECT_CALL(si, AddCoffee(70)).Times(1);
+    EXPECT_CALL(si, AddMilkFoam(35)).Times(1);
+
+    cm.CreateCoffee(Cup::Big, Coffee::Latte);
+}
+
+//- marochino - chocolate & coffee & milk foam, 1:4, 1:4, 1:4 and 1:4 is empty
+TEST(CoffeeMachine, Marochino)
+{
+    MockSourceOfIngredients si;
+    CoffeeMachine cm(si);
+
+    EXPECT_CALL(si, SetCupSize(100)).Times(1);
+    EXPECT_CALL(si, AddChocolate(25)).Times(1);
+    EXPECT_CALL(si, AddCoffee(25)).Times(1);
+    EXPECT_CALL(si, AddMilkFoam(25)).Times(1);
+
+    cm.CreateCoffee(Cup::Normal, Coffee::Marochino);
+}
+
+TEST(CoffeeMachine, BigMarochino)
+{
+    MockSourceOfIngredients si;
+    CoffeeMachine cm(si);
+
+    EXPECT_CALL(si, SetCupSize(140)).Times(1);
+    EXPECT_CALL(si, AddChocolate(35)).Times(1);
+    EXPECT_CALL(si, AddCoffee(35)).Times(1);
+    EXPECT_CALL(si, AddMilkFoam(35)).Times(1);
+
+    cm.CreateCoffee(Cup::Big, Coffee::Marochino);
+}
+
+TEST(CoffeeMachine, SetsCupSizeFirst)
+{
+    ::testing::NiceMock<MockSourceOfIngredients> si;
+    CoffeeMachine cm(si);
+
+    ::testing::InSequence sequence;
+    EXPECT_CALL(si, SetCupSize(100)).Times(1);
+    EXPECT_CALL(si, AddMilk(25)).Times(1);
+
+    cm.CreateCoffee(Cup::Normal, Coffee::Latte);
+}
+
+TEST(CoffeeMachine, HeatsWaterBeforeBrewing)
+{
+    ::testing::NiceMock<MockHeatingSourceOfIngredients> si;
+    CoffeeMachine cm(si);
+
+    ::testing::InSequence sequence;
+    EXPECT_CALL(si, SetCupSize(100)).Times(1);
+    EXPECT_CALL(si, SetWaterTemperature(80)).Times(1);
+    EXPECT_CALL(si, AddMilk(33)).Times(1);
+    EXPECT_CALL(si, AddCoffee(33)).Times(1);
+
+    cm.CreateCoffee(Cup::Normal, Coffee::Cappuccino);
+}
+
+TEST(CoffeeMachine, HeatsWaterToRecipeTemperature)
+{
+    ::testing::NiceMock<MockHeatingSourceOfIngredients> si;
+    CoffeeMachine cm(si);
+
+    EXPECT_CALL(si, SetWaterTemperature(60)).Times(2);
+    EXPECT_CALL(si, SetWaterTemperature(90)).Times(1);
+
+    cm.CreateCoffee(Cup::Normal, Coffee::Americano);
+    cm.CreateCoffee(Cup::Big, Coffee::Americano);
+    cm.CreateCoffee(Cup::Big, Coffee::Latte);
+}
+
+TEST(CoffeeMachine, MarochinoDoesNotHeatWater)
+{
+    ::testing::NiceMock<MockHeatingSourceOfIngredients> si;
+    CoffeeMachine cm(si);
+
+    EXPECT_CALL(si, SetWaterTemperature(::testing::_)).Times(0);
+
+    cm.CreateCoffee(Cup::Big, Coffee::Marochino);
+}
+
+TEST(ISourceOfIngredients, IgnoresWaterTemperatureByDefault)
+{
+    ::testing::StrictMock<MockSourceOfIngredients> si;
+    const IngredientCommand command = {Ingredient::WaterTemperature, 0, 90};
+
+    si.Execute(&command, 1);
+}
+
+TEST(CoffeeProgram, CompiledAheadOfTime)
+{
+    static_assert(s_programs[Big][Latte].size == 5, "latte has cup size, water temperature and three portions");
+    static_assert(s_programs[Big][Latte].commands[3].gram == 70, "latte is half coffee");
+    static_assert(s_programs[Normal][Americano].commands[1].ingredient == Ingredient::WaterTemperature &&
+                  s_programs[Normal][Americano].commands[1].temperature == 60, "americano water is heated to 60C");
+    static_assert(s_programs[Normal][Americano].commands[3].temperature == 60, "americano water is 60C");
+    static_assert(s_programs[Normal][Americano].commands[2].temperature == 0, "coffee does not carry temperature");
+    static_assert(s_programs[Big][Marochino].size == 4, "marochino does not heat the water");
+    EXPECT_EQ(4u, s_programs[Normal][Americano].size);
+}
+
+TEST(CoffeeMachine, UsesBatchExecutionWhenAvailable)
+{
+    MockBatchSourceOfIngredients si;
+    CoffeeMachine cm(si);
+
+    EXPECT_CALL(si, Execute(s_programs[Big][Cappuccino].commands, 5)).Times(1);
+    EXPECT_CALL(si, SetCupSize(::testing::_)).Times(0);
+    EXPECT_CALL(si, AddMilk(::testing::_)).Times(0);
+    EXPECT_CALL(si, AddCoffee(::testing::_)).Times(0);
+    EXPECT_CALL(si, AddMilkFoam(::testing::_)).Times(0);
+
+    cm.CreateCoffee(Cup::Big, Coffee::Cappuccino);
+}
+
+TEST(ISourceOfIngredients, ExecutesEachCommandByDefault)
+{
+    MockHeatingSourceOfIngredients si;
+    const IngredientCommand commands[] = {
+        {Ingredient::CupSize, 140, 0},
+        {Ingredient::WaterTemperature, 0, 70},
+        {Ingredient::Water, 20, 90},
+        {Ingredient::Sugar, 5, 0},
+        {Ingredient::Cream, 15, 0}
+    };
+
+    ::testing::InSequence sequence;
+    EXPECT_CALL(si, SetCupSize(140)).Times(1);
+    EXPECT_CALL(si, SetWaterTemperature(70)).Times(1);
+    EXPECT_CALL(si, AddWater(20, 90)).Times(1);
+    EXPECT_CALL(si, AddSugar(5)).Times(1);
+    EXPECT_CALL(si, AddCream(15)).Times(1);
+
+    si.Execute(commands, 5);
+}
+
+// Counts brewed cups, safe to use from a scheduler thread
+class CountingSourceOfIngredients : public ISourceOfIngredients
+{
+public:
+    void SetCupSize(int) override
+    {
+        ++cups;
+    }
+    void AddWater(int, int) override {}
+    void AddSugar(int) override {}
+    void AddCoffee(int) override {}
+    void AddMilk(int) override {}
+    void AddMilkFoam(int) override {}
+    void AddChocolate(int) override {}
+    void AddCream(int) override {}
+
+    std::atomic<int> cups{0};
+};
+
+TEST(OrderScheduler, EmptyRun)
+{
+    std::vector<CoffeeMachine*> machines;
+    OrderScheduler scheduler(machines);
+    SchedulerReport report = scheduler.Run();
+    EXPECT_EQ(0u, report.orders);
+    EXPECT_EQ(0u, report.heatUps);
+}
+
+TEST(OrderScheduler, BrewsEveryOrderOnce)
+{
+    const size_t machinesCount = 4;
+    const size_t ordersCount = 1000;
+
+    std::vector<CountingSourceOfIngredients> sources(machinesCount);
+    std::vector<CoffeeMachine> machines;
+    std::vector<CoffeeMachine*> machinePointers;
+    machines.reserve(machinesCount);
+    for (CountingSourceOfIngredients& source : sources)
+    {
+        machines.emplace_back(source);
+        machinePointers.push_back(&machines.back());
+    }
+
+    OrderScheduler scheduler(machinePointers);
+    for (size_t i = 0; i < ordersCount; ++i)
+    {
+        scheduler.Submit(i % 3 ? Cup::Normal : Cup::Big, static_cast<Coffee>(i % s_coffeesCount));
+    }
+    SchedulerReport report = scheduler.Run();
+
+    size_t cups = 0;
+    for (CountingSourceOfIngredients& source : sources)
+    {
+        cups += static_cast<size_t>(source.cups);
+    }
+    EXPECT_EQ(ordersCount, cups);
+    EXPECT_EQ(ordersCount, report.orders);
+    EXPECT_GT(report.ordersPerSecond, 0);
+    EXPECT_GT(report.p99Latency.count(), 0);
+}
+
+TEST(OrderScheduler, GroupsOrdersByWaterTemperature)
+{
+    CountingSourceOfIngredients source;
+    CoffeeMachine machine(source);
+    OrderScheduler scheduler({&machine});
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        scheduler.Submit(Cup::Normal, Coffee::Americano);
+        scheduler.Submit(Cup::Normal, Coffee::Latte);
+        scheduler.Submit(Cup::Big, Coffee::Americano);
+    }
+    SchedulerReport report = scheduler.Run();
+
+    EXPECT_EQ(9u, report.orders);
+    EXPECT_EQ(2u, report.heatUps);
+    EXPECT_EQ(9, source.cups);
+}
+
+TEST(OrderScheduler, RunsAgainForNewOrders)
+{
+    CountingSourceOfIngredients source;
+    CoffeeMachine machine(source);
+    OrderScheduler scheduler({&machine});
+
+    scheduler.Submit(Cup::Normal, Coffee::Americano);
+    EXPECT_EQ(1u, scheduler.Run().orders);
+
+    scheduler.Submit(Cup::Normal, Coffee::Americano);
+    scheduler.Submit(Cup::Normal, Coffee::Americano);
+    SchedulerReport report = scheduler.Run();
+    EXPECT_EQ(2u, report.orders);
+    EXPECT_EQ(1u, report.heatUps);
+}
+
+TEST(BoundedQueue, FirstInFirstOut)
+{
+    BoundedQueue<int, 4> queue;
+    int value = 0;
+    EXPECT_FALSE(queue.TryPop(value));
+
+    for (int i = 0; i < 4; ++i)
+    {
+        EXPECT_TRUE(queue.TryPush(i));
+    }
+    EXPECT_FALSE(queue.TryPush(4));
+    EXPECT_EQ(4u, queue.GetSize());
+
+    for (int i = 0; i < 4; ++i)
+    {
+        EXPECT_TRUE(queue.TryPop(value));
+        EXPECT_EQ(i, value);
+    }
+    EXPECT_FALSE(queue.TryPop(value));
+    EXPECT_EQ(0u, queue.GetSize());
+}
+
+TEST(BoundedQueue, WrapsAround)
+{
+    BoundedQueue<int, 2> queue;
+    for (int i = 0; i < 100; ++i)
+    {
+        int value = -1;
+        ASSERT_TRUE(queue.TryPush(i));
+        ASSERT_TRUE(queue.TryPop(value));
+        EXPECT_EQ(i, value);
+    }
+}
+
+TEST(BoundedQueue, ConcurrentProducersAndConsumers)
+{
+    const size_t threadsCount = 4;
+    const int valuesPerProducer = 20000;
+
+    BoundedQueue<int, 64> queue;
+    std::atomic<long long> sum(0);
+    std::atomic<int> popped(0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < threadsCount; ++i)
+    {
+        threads.emplace_back([&]()
+        {
+            for (int value = 1; value <= valuesPerProducer; ++value)
+            {
+                while (!queue.TryPush(value))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        threads.emplace_back([&]()
+        {
+            int value = 0;
+            while (popped < static_cast<int>(threadsCount) * valuesPerProducer)
+            {
+                if (queue.TryPop(value))
+                {
+                    sum += value;
+                    ++popped;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(static_cast<int>(threadsCount) * valuesPerProducer, popped);
+    EXPECT_EQ(static_cast<long long>(threadsCount) * valuesPerProducer * (valuesPerProducer + 1) / 2, sum);
+}
+
+// Polls the condition for up to 5 seconds
+template<typename Condition>
+bool WaitUntil(Condition condition)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!condition())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+TEST(OrderScheduler, ServesOrdersSubmittedWhileRunning)
+{
+    const size_t producersCount = 4;
+    const size_t ordersPerProducer = 250;
+
+    CountingSourceOfIngredients firstSource;
+    CountingSourceOfIngredients secondSource;
+    CoffeeMachine firstMachine(firstSource);
+    CoffeeMachine secondMachine(secondSource);
+    OrderScheduler scheduler({&firstMachine, &secondMachine});
+
+    scheduler.Start();
+    std::atomic<size_t> accepted(0);
+    std::vector<std::thread> producers;
+    for (size_t i = 0; i < producersCount; ++i)
+    {
+        producers.emplace_back([&]()
+        {
+            for (size_t order = 0; order < ordersPerProducer; ++order)
+            {
+                accepted += scheduler.Submit(order % 2 ? Cup::Normal : Cup::Big,
+                                             static_cast<Coffee>(order % s_coffeesCount));
+            }
+        });
+    }
+    for (std::thread& producer : producers)
+    {
+        producer.join();
+    }
+
+    const int ordersCount = static_cast<int>(producersCount * ordersPerProducer);
+    EXPECT_EQ(producersCount * ordersPerProducer, accepted);
+    EXPECT_TRUE(WaitUntil([&]() { return firstSource.cups + secondSource.cups == ordersCount; }));
+
+    const SchedulerReport report = scheduler.Stop();
+    EXPECT_EQ(producersCount * ordersPerProducer, report.orders);
+}
+
+// Keeps its machine busy with the first cup until released
+class BlockingSourceOfIngredients : public CountingSourceOfIngredients
+{
+public:
+    void SetCupSize(int gram) override
+    {
+        CountingSourceOfIngredients::SetCupSize(gram);
+        while (!released)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    std::atomic<bool> released{false};
+};
+
+TEST(OrderScheduler, IdleMachineStealsPrefetchedOrders)
+{
+    BlockingSourceOfIngredients busySource;
+    CountingSourceOfIngredients idleSource;
+    CoffeeMachine busyMachine(busySource);
+    CoffeeMachine idleMachine(idleSource);
+    OrderScheduler scheduler({&busyMachine, &idleMachine});
+
+    scheduler.Start();
+    for (size_t i = 0; i < 8; ++i)
+    {
+        scheduler.Submit(Cup::Normal, Coffee::Americano);
+    }
+
+    // The busy machine brews at most one order, the idle machine takes the rest
+    EXPECT_TRUE(WaitUntil([&]() { return busySource.cups + idleSource.cups == 8; }));
+    EXPECT_LE(busySource.cups, 1);
+
+    busySource.released = true;
+    EXPECT_EQ(8u, scheduler.Stop().orders);
+}
+
+TEST(OrderScheduler, CountsEveryOrderUnderStealing)
+{
+    const size_t machinesCount = 8;
+    const size_t producersCount = 4;
+    const size_t ordersPerProducer = 5000;
+
+    std::vector<CountingSourceOfIngredients> sources(machinesCount);
+    std::vector<CoffeeMachine> machines;
+    std::vector<CoffeeMachine*> machinePointers;
+    machines.reserve(machinesCount);
+    for (CountingSourceOfIngredients& source : sources)
+    {
+        machines.emplace_back(source);
+        machinePointers.push_back(&machines.back());
+    }
+    OrderScheduler scheduler(machinePointers);
+
+    // Orders trickle in, so machines keep running out of work and steal from each other
+    scheduler.Start();
+    std::atomic<size_t> accepted(0);
+    std::vector<std::thread> producers;
+    for (size_t i = 0; i < producersCount; ++i)
+    {
+        producers.emplace_back([&]()
+        {
+            for (size_t order = 0; order < ordersPerProducer; ++order)
+            {
+                accepted += scheduler.Submit(Cup::Normal, static_cast<Coffee>(order % s_coffeesCount));
+                if (order % 8 == 0)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (std::thread& producer : producers)
+    {
+        producer.join();
+    }
+    const SchedulerReport report = scheduler.Stop();
+
+    size_t cups = 0;
+    for (CountingSourceOfIngredients& source : sources)
+    {
+        cups += static_cast<size_t>(source.cups);
+    }
+    EXPECT_EQ(producersCount * ordersPerProducer, accepted);
+    EXPECT_EQ(accepted, cups);
+    EXPECT_EQ(accepted, report.orders);
+}
+
+TEST(OrderScheduler, RejectsOrdersWhenQueueIsFull)
+{
+    CountingSourceOfIngredients source;
+    CoffeeMachine machine(source);
+    OrderScheduler scheduler({&machine});
+
+    size_t accepted = 0;
+    while (scheduler.Submit(Cup::Normal, Coffee::Latte))
+    {
+        ++accepted;
+    }
+    EXPECT_GT(accepted, 0u);
+    EXPECT_TRUE(scheduler.Submit(Cup::Normal, Coffee::Americano));
+    EXPECT_EQ(accepted + 1, scheduler.Run().orders);
+}
+
+TEST(OrderScheduler, StartsOnlyOnce)
+{
+    std::vector<CoffeeMachine*> machines;
+    OrderScheduler scheduler(machines);
+
+    EXPECT_THROW(scheduler.Stop(), std::runtime_error);
+    scheduler.Start();
+    EXPECT_THROW(scheduler.Start(), std::runtime_error);
+    scheduler.Stop();
+}
+
+TEST(SimulatedSourceOfIngredients, CountsStepTimes)
+{
+    SimulationTimings timings;
+    SimulatedSourceOfIngredients source(timings, 60);
+
+    source.SetCupSize(100);
+    source.AddMilk(10);
+    source.AddMilkFoam(10);
+    source.AddChocolate(10);
+
+    EXPECT_EQ(timings.cupChange + timings.pumpPerGram * 10 + timings.foamPerGram * 10 + timings.dosePerGram * 10,
+              source.GetElapsed());
+}
+
+TEST(SimulatedSourceOfIngredients, HeatsWaterOnlyWhenTemperatureChanges)
+{
+    SimulationTimings timings;
+    SimulatedSourceOfIngredients source(timings, 20);
+
+    source.AddWater(10, 60);
+    EXPECT_EQ(timings.heatPerDegree * 40 + timings.pumpPerGram * 10, source.GetElapsed());
+    EXPECT_EQ(60, source.GetWaterTemperature());
+
+    source.AddWater(10, 60);
+    EXPECT_EQ(timings.heatPerDegree * 40 + timings.pumpPerGram * 20, source.GetElapsed());
+}
+
+TEST(SimulatedSourceOfIngredients, BrewsCoffeeAtRecipeTemperature)
+{
+    SimulationTimings timings;
+    SimulatedSourceOfIngredients source(timings, 20);
+    CoffeeMachine machine(source);
+
+    machine.CreateCoffee(Cup::Normal, Coffee::Latte);
+
+    EXPECT_EQ(90, source.GetWaterTemperature());
+    EXPECT_EQ(timings.cupChange + timings.pumpPerGram * 25 + timings.heatPerDegree * 70 +
+              timings.dosePerGram * 50 + timings.foamPerGram * 25, source.GetElapsed());
+}
+
+TEST(SimulatedSourceOfIngredients, BatchTakesAsLongAsIndividualCalls)
+{
+    SimulationTimings timings;
+    SimulatedSourceOfIngredients batchSource(timings, 20);
+    SimulatedSourceOfIngredients callsSource(timings, 20);
+
+    const CoffeeProgram& program = s_programs[Normal][Latte];
+    batchSource.Execute(program.commands, program.size);
+
+    callsSource.SetCupSize(100);
+    callsSource.SetWaterTemperature(90);
+    callsSource.AddMilk(25);
+    callsSource.AddCoffee(50);
+    callsSource.AddMilkFoam(25);
+
+    EXPECT_EQ(callsSource.GetElapsed(), batchSource.GetElapsed());
+    EXPECT_EQ(90, batchSource.GetWaterTemperature());
+    EXPECT_EQ(90, callsSource.GetWaterTemperature());
+}
+
+TEST(SimulatedSourceOfIngredients, GroupedOrdersBrewFaster)
+{
+    SimulatedSourceOfIngredients interleavedSource;
+    CoffeeMachine interleaved(interleavedSource);
+    SimulatedSourceOfIngredients groupedSource;
+    CoffeeMachine grouped(groupedSource);
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        interleaved.CreateCoffee(Cup::Normal, Coffee::Americano);
+        interleaved.CreateCoffee(Cup::Normal, Coffee::Latte);
+    }
+    for (size_t i = 0; i < 10; ++i)
+    {
+        grouped.CreateCoffee(Cup::Normal, Coffee::Americano);
+    }
+    for (size_t i = 0; i < 10; ++i)
+    {
+        grouped.CreateCoffee(Cup::Normal, Coffee::Latte);
+    }
+
+    EXPECT_GT(GetOrdersPerHour(20, groupedSource.GetElapsed()), GetOrdersPerHour(20, interleavedSource.GetElapsed()));
+}
+
+TEST(SimulatedSourceOfIngredients, FleetHourThroughScheduler)
+{
+    const size_t machinesCount = 4;
+    const size_t ordersCount = 2000;
+
+    std::vector<SimulatedSourceOfIngredients> sources(machinesCount);
+    std::vector<CoffeeMachine> machines;
+    std::vector<CoffeeMachine*> machinePointers;
+    machines.reserve(machinesCount);
+    for (SimulatedSourceOfIngredients& source : sources)
+    {
+        machines.emplace_back(source);
+        machinePointers.push_back(&machines.back());
+    }
+
+    OrderScheduler scheduler(machinePointers);
+    for (size_t i = 0; i < ordersCount; ++i)
+    {
+        scheduler.Submit(i % 2 ? Cup::Normal : Cup::Big, static_cast<Coffee>(i % s_coffeesCount));
+    }
+    const SchedulerReport report = scheduler.Run();
+
+    std::chrono::milliseconds busiest(0);
+    for (const SimulatedSourceOfIngredients& source : sources)
+    {
+        busiest = std::max(busiest, source.GetElapsed());
+    }
+
+    EXPECT_EQ(ordersCount, report.orders);
+    EXPECT_GT(busiest, std::chrono::hours(1));
+    EXPECT_GT(GetOrdersPerHour(report.orders, busiest), 0);
+}
+
+TEST(IngredientsInventory, EmptyByDefault)
+{
+    IngredientsInventory inventory;
+    EXPECT_EQ(0, inventory.GetStock(Ingredient::Coffee));
+    EXPECT_EQ(0, inventory.GetStock(Ingredient::Cream));
+}
+
+TEST(IngredientsInventory, ReservesAllIngredients)
+{
+    IngredientsInventory inventory;
+    inventory.Refill(Ingredient::Coffee, 100);
+    inventory.Refill(Ingredient::Water, 100);
+
+    const CoffeeProgram& program = s_programs[Normal][Americano];
+    ASSERT_TRUE(inventory.Reserve(program.commands, program.size));
+    EXPECT_EQ(25, inventory.GetStock(Ingredient::Coffee));
+    EXPECT_EQ(75, inventory.GetStock(Ingredient::Water));
+}
+
+TEST(IngredientsInventory, RejectsNegativeRefill)
+{
+    IngredientsInventory inventory;
+    inventory.Refill(Ingredient::Coffee, 100);
+
+    EXPECT_THROW(inventory.Refill(Ingredient::Coffee, -50), std::invalid_argument);
+    EXPECT_EQ(100, inventory.GetStock(Ingredient::Coffee));
+}
+
+TEST(IngredientsInventory, RejectsStockOverflow)
+{
+    IngredientsInventory inventory;
+    inventory.Refill(Ingredient::Coffee, INT_MAX - 100);
+
+    EXPECT_THROW(inventory.Refill(Ingredient::Coffee, 101), std::overflow_error);
+    EXPECT_EQ(INT_MAX - 100, inventory.GetStock(Ingredient::Coffee));
+
+    inventory.Refill(Ingredient::Coffee, 100);
+    EXPECT_EQ(INT_MAX, inventory.GetStock(Ingredient::Coffee));
+    EXPECT_THROW(inventory.Refill(Ingredient::Coffee, INT_MAX), std::overflow_error);
+
+    // Reservations keep working on a full stock
+    const IngredientCommand espresso[] = {{Ingredient::Coffee, 10, 0}};
+    ASSERT_TRUE(inventory.Reserve(espresso, 1));
+    EXPECT_EQ(INT_MAX - 10, inventory.GetStock(Ingredient::Coffee));
+    inventory.Release(espresso, 1);
+    EXPECT_EQ(INT_MAX, inventory.GetStock(Ingredient::Coffee));
+}
+
+TEST(IngredientsInventory, RollsBackOnShortage)
+{
+    IngredientsInventory inventory;
+    inventory.Refill(Ingredient::Milk, 100);
+    inventory.Refill(Ingredient::Coffee, 100);
+    inventory.Refill(Ingredient::MilkFoam, 10);
+
+    const CoffeeProgram& program = s_programs[Normal][Latte];
+    EXPECT_FALSE(inventory.Reserve(program.commands, program.size));
+    EXPECT_EQ(100, inventory.GetStock(Ingredient::Milk));
+    EXPECT_EQ(100, inventory.GetStock(Ingredient::Coffee));
+    EXPECT_EQ(10, inventory.GetStock(Ingredient::MilkFoam));
+}
+
+TEST(CoffeeMachine, DoesNotBrewWithoutIngredients)
+{
+    ::testing::StrictMock<MockSourceOfIngredients> si;
+    IngredientsInventory inventory;
+    inventory.Refill(Ingredient::Coffee, 50);
+    CoffeeMachine cm(si, &inventory);
+
+    EXPECT_FALSE(cm.CreateCoffee(Cup::Normal, Coffee::Americano));
+    EXPECT_EQ(50, inventory.GetStock(Ingredient::Coffee));
+}
+
+TEST(CoffeeMachine, TakesIngredientsFromInventory)
+{
+    ::testing::NiceMock<MockSourceOfIngredients> si;
+    IngredientsInventory inventory;
+    inventory.Refill(Ingredient::Chocolate, 50);
+    inventory.Refill(Ingredient::Coffee, 50);
+    inventory.Refill(Ingredient::MilkFoam, 50);
+    CoffeeMachine cm(si, &inventory);
+
+    EXPECT_CALL(si, AddChocolate(25)).Times(2);
+
+    EXPECT_TRUE(cm.CreateCoffee(Cup::Normal, Coffee::Marochino));
+    EXPECT_TRUE(cm.CreateCoffee(Cup::Normal, Coffee::Marochino));
+    EXPECT_FALSE(cm.CreateCoffee(Cup::Normal, Coffee::Marochino));
+    EXPECT_EQ(0, inventory.GetStock(Ingredient::Chocolate));
+}
+
+TEST(CoffeeMachine, ReturnsIngredientsIfSourceFails)
+{
+    ::testing::NiceMock<MockSourceOfIngredients> si;
+    IngredientsInventory inventory;
+    inventory.Refill(Ingredient::Coffee, 100);
+    inventory.Refill(Ingredient::Water, 100);
+    CoffeeMachine cm(si, &inventory);
+
+    EXPECT_CALL(si, AddWater(::testing::_, ::testing::_)).WillOnce(::testing::Throw(std::runtime_error("No water")));
+
+    EXPECT_THROW(cm.CreateCoffee(Cup::Normal, Coffee::Americano), std::runtime_error);
+    EXPECT_EQ(100, inventory.GetStock(Ingredient::Coffee));
+    EXPECT_EQ(100, inventory.GetStock(Ingredient::Water));
+}
+
+TEST(IngredientsInventory, ConcurrentOrdersNeverOversell)
+{
+    const size_t threadsCount = 64;
+    const size_t attemptsPerThread = 50;
+    const int americanosInStock = 1000;
+
+    IngredientsInventory inventory;
+    inventory.Refill(Ingredient::Coffee, 75 * americanosInStock);
+    inventory.Refill(Ingredient::Water, 25 * americanosInStock + 10);
+
+    std::atomic<int> brewed(0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < threadsCount; ++i)
+    {
+        threads.emplace_back([&]()
+        {
+            CountingSourceOfIngredients source;
+            CoffeeMachine machine(source, &inventory);
+            for (size_t attempt = 0; attempt < attemptsPerThread; ++attempt)
+            {
+                brewed += machine.CreateCoffee(Cup::Normal, Coffee::Americano);
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(americanosInStock, brewed);
+    EXPECT_EQ(0, inventory.GetStock(Ingredient::Coffee));
+    EXPECT_EQ(10, inventory.GetStock(Ingredient::Water));
+}
+
+TEST(IngredientsInventory, FailingRecipeDoesNotStarveCompetitor)
+{
+    const size_t threadsCount = 8;
+    const size_t espressosPerThread = 200;
+    const int espressoGrams = 10;
+
+    // Latte holds coffee while it fails on missing milk foam, espresso needs coffee only
+    IngredientsInventory inventory;
+    inventory.Refill(Ingredient::Coffee, espressoGrams * static_cast<int>(threadsCount / 2 * espressosPerThread));
+    inventory.Refill(Ingredient::Milk, 1000000);
+    const CoffeeProgram& latte = s_programs[Big][Latte];
+    const IngredientCommand espresso[] = {{Ingredient::Coffee, espressoGrams, 0}};
+
+    std::atomic<size_t> espressosLeft(threadsCount / 2);
+    std::atomic<int> espressos(0);
+    std::atomic<int> lattes(0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < threadsCount; ++i)
+    {
+        if (i % 2)
+        {
+            threads.emplace_back([&]()
+            {
+                for (size_t attempt = 0; attempt < espressosPerThread; ++attempt)
+                {
+                    espressos += inventory.Reserve(espresso, 1);
+                }
+                --espressosLeft;
+            });
+        }
+        else
+        {
+            threads.emplace_back([&]()
+            {
+                while (espressosLeft != 0)
+                {
+                    lattes += inventory.Reserve(latte.commands, latte.size);
+                }
+            });
+        }
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(static_cast<int>(threadsCount / 2 * espressosPerThread), espressos);
+    EXPECT_EQ(0, lattes);
+    EXPECT_EQ(0, inventory.GetStock(Ingredient::Coffee));
+    EXPECT_EQ(1000000, inventory.GetStock(Ingredient::Milk));
+}
+
+TEST(OrderScheduler, ReportsRejectedOrders)
+{
+    CountingSourceOfIngredients source;
+    IngredientsInventory inventory;
+    inventory.Refill(Ingredient::Coffee, 100);
+    inventory.Refill(Ingredient::Water, 100);
+    CoffeeMachine machine(source, &inventory);
+    OrderScheduler scheduler({&machine});
+
+    scheduler.Submit(Cup::Normal, Coffee::Americano);
+    scheduler.Submit(Cup::Normal, Coffee::Americano);
+    SchedulerReport report = scheduler.Run();
+
+    EXPECT_EQ(1u, report.orders);
+    EXPECT_EQ(1u, report.rejected);
+}
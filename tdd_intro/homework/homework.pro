@@ -5,5 +5,6 @@ SUBDIRS += \
     02_ternary_numbers \
     03_bank_ocr \
     04_weather_client \
+    04_weather_client/weather_server \
     05_word_wrapp \
     06_coffee